@@ -0,0 +1,177 @@
+# encoding: utf-8
+
+# Crash recovery harness. For every libfiu failure point in the commit path, a forked writer commits
+# a backlog of lingering transactions, enables the point and starts one more operation, which exits
+# the process once the point is reached. The parent then times JIO.check over the left behind journal
+# and verifies the file: every backlog record must be there, and the interrupted transaction must be
+# either fully applied or not at all.
+#
+# Requires the extension to be built against libfiu, from a clean tree:
+#
+#   JIO_FIU=1 rake clean compile
+#   rake recovery BACKLOG=0,1000,10000 RECORD_SIZE=4096 RUNS=3 MAX_SECONDS=2
+#
+# POINTS narrows the run down to a comma separated list of failure points. With MAX_SECONDS, the
+# harness exits non zero if recovering from any point takes longer, if any check leaves the file
+# inconsistent, or if any writer didn't crash at its point (it was never reached, or the writer failed
+# before it).
+
+$:.unshift File.expand_path(File.join(File.dirname(__FILE__), '..', 'lib'))
+$:.unshift File.expand_path(File.join(File.dirname(__FILE__), '..', 'ext', 'jio'))
+
+require 'jio'
+require 'fileutils'
+
+module JIO
+  class RecoveryHarness
+    # Failure points, along with the operation that reaches them
+    POINTS = [
+      ['jio/commit/created_tf', :commit],
+      ['jio/commit/tf_header', :commit],
+      ['jio/commit/tf_pre_addop', :commit],
+      ['jio/commit/tf_addop', :commit],
+      ['jio/commit/tf_opdata', :commit],
+      ['jio/commit/tf_data', :commit],
+      ['jio/commit/tf_sync', :commit],
+      ['jio/commit/wrote_op', :commit],
+      ['jio/commit/wrote_all_ops', :commit],
+      ['jio/commit/pre_ok_free_tid', :commit],
+      ['jio/jsync/pre_unlink', :sync],
+      ['jio/multi/pre_sync', :multi],
+      ['jio/multi/synced', :multi],
+      ['jio/multi/wrote_op', :multi],
+      ['jio/multi/pre_unlink', :multi]
+    ]
+
+    RECORD_SIZE = 4096
+
+    attr_reader :results
+
+    def initialize(dir, options = {})
+      @dir = dir
+      @backlogs = options[:backlogs] || [0, 100, 1000]
+      @record_size = options[:record_size] || RECORD_SIZE
+      @runs = options[:runs] || 1
+      @points = POINTS
+      @points = @points.select{|point, op| options[:points].include?(point) } if options[:points]
+      @results = []
+    end
+
+    def run(out = $stdout)
+      raise NotImplementedError, "the jio extension wasn't built with --enable-fiu" unless JIO.respond_to?(:fail_at)
+      out.puts format_row(%w(point backlog status reapplied broken journal_kb check_ms consistent))
+      @points.each do |point, op|
+        @backlogs.each do |backlog|
+          runs = (1..@runs).map{ crash(point, op, backlog) }
+          result = runs.max{|a, b| a[:seconds] <=> b[:seconds] }
+          result[:status] = (runs.map{|r| r[:status] } - [:crashed]).first || :crashed
+          result[:consistent] = runs.all?{|r| r[:consistent] }
+          @results << result
+          out.puts format_row([point, backlog, result[:status], result[:reapplied], result[:broken],
+            result[:journal_bytes] / 1024, (result[:seconds] * 1000).round, result[:consistent]])
+        end
+      end
+      @results
+    end
+
+    # Crashes a writer at the given point and recovers its files
+    def crash(point, op, backlog)
+      FileUtils.rm_rf(@dir)
+      FileUtils.mkdir_p(@dir)
+      pid = fork do
+        begin
+          write(point, op, backlog)
+          exit!(0)
+        rescue Exception
+          exit!(2)
+        end
+      end
+      Process.wait(pid)
+      status = case $?.exitstatus
+        when 1 then :crashed
+        when 0 then :unreached
+        else :error
+      end
+      result = {:point => point, :backlog => backlog, :status => status, :journal_bytes => journal_bytes}
+      started = Time.now
+      res = JIO.check(path('file'), 0)
+      JIO.check(path('other'), 0) if op == :multi
+      result[:seconds] = Time.now - started
+      result[:reapplied] = res[:reapplied]
+      result[:broken] = res[:broken]
+      # a writer that never crashed didn't exercise its point, so proves nothing about recovery
+      result[:consistent] = status == :crashed && consistent?(op, backlog)
+      result
+    end
+
+    private
+    def write(point, op, backlog)
+      file = JIO.open(path('file'), JIO::RDWR | JIO::CREAT | JIO::TRUNC, 0644, 0)
+      other = JIO.open(path('other'), JIO::RDWR | JIO::CREAT | JIO::TRUNC, 0644, 0) if op == :multi
+      backlog.times{|i| file.transaction(JIO::J_LINGER){|t| t.write(record(i), i * @record_size) } }
+      JIO.fail_at(point)
+      offset = backlog * @record_size
+      case op
+      when :commit
+        file.transaction(0){|t| t.write(record(backlog), offset) }
+      when :sync
+        file.transaction(JIO::J_LINGER){|t| t.write(record(backlog), offset) }
+        file.sync
+      when :multi
+        JIO.transaction(file, other) do |t|
+          t.write(file, record(backlog), offset)
+          t.write(other, record(backlog), 0)
+        end
+      end
+    end
+
+    # Backlog records are committed, so must all be there. The interrupted operation is all or nothing,
+    # across both files for multi file transactions.
+    def consistent?(op, backlog)
+      data = ::File.exist?(path('file')) ? ::File.open(path('file'), 'rb'){|f| f.read } : ''
+      (0...backlog).each do |i|
+        return false unless data[i * @record_size, @record_size] == record(i)
+      end
+      tail = data[backlog * @record_size, @record_size]
+      applied = tail == record(backlog)
+      return false unless applied || tail.nil? || tail.empty?
+      return true unless op == :multi
+      other = ::File.exist?(path('other')) ? ::File.open(path('other'), 'rb'){|f| f.read } : ''
+      applied ? other == record(backlog) : other.empty?
+    end
+
+    def record(i)
+      ("%08d" % i) * (@record_size / 8) + ' ' * (@record_size % 8)
+    end
+
+    def journal_bytes
+      Dir[::File.join(@dir, '.*.jio', '*')].inject(0){|sum, f| sum + ::File.size(f) }
+    end
+
+    def path(name)
+      ::File.join(@dir, name)
+    end
+
+    def format_row(cols)
+      cols.map{|c| c.to_s }.zip([28, 8, 10, 10, 7, 11, 9, 10]).map{|c, w| c.ljust(w) }.join(' ')
+    end
+  end
+end
+
+if $0 == __FILE__
+  harness = JIO::RecoveryHarness.new(ENV['DIR'] || ::File.join(::File.dirname(__FILE__), '..', 'tmp', 'recovery'),
+    :backlogs => (ENV['BACKLOG'] || '0,100,1000').split(',').map{|b| b.to_i },
+    :record_size => (ENV['RECORD_SIZE'] || JIO::RecoveryHarness::RECORD_SIZE).to_i,
+    :runs => (ENV['RUNS'] || 1).to_i,
+    :points => ENV['POINTS'] && ENV['POINTS'].split(','))
+  results = harness.run
+  if ENV['MAX_SECONDS']
+    slow = results.select{|r| r[:seconds] > ENV['MAX_SECONDS'].to_f }
+    slow.each{|r| $stderr.puts "recovery from #{r[:point]} with a backlog of #{r[:backlog]} took #{r[:seconds]}s" }
+    missed = results.reject{|r| r[:status] == :crashed }
+    missed.each{|r| $stderr.puts "writer #{r[:status]} at #{r[:point]} with a backlog of #{r[:backlog]}" }
+    bad = results.reject{|r| r[:consistent] } - missed
+    bad.each{|r| $stderr.puts "inconsistent file after recovering from #{r[:point]} with a backlog of #{r[:backlog]}" }
+    exit(1) unless slow.empty? && missed.empty? && bad.empty?
+  end
+end
@@ -0,0 +1,94 @@
+# encoding: utf-8
+
+# Append throughput of JIO::ShardedLog as writer threads spread over more shards. Every thread appends
+# records under its own key, with keys picked so that each shard gets the same number of writers.
+# Synced commits to different shards only overlap when the extension releases the GVL around them,
+# so throughput should grow with the shard count up to the number of threads.
+#
+#   rake sharded_log THREADS=4 SHARDS=1,2,4 APPENDS=200 RECORD_SIZE=256 MIN_SPEEDUP=1.5
+#
+# With MIN_SPEEDUP, the harness exits non zero unless the largest shard count beats a single shard by
+# at least that factor.
+
+$:.unshift File.expand_path(File.join(File.dirname(__FILE__), '..', 'lib'))
+$:.unshift File.expand_path(File.join(File.dirname(__FILE__), '..', 'ext', 'jio'))
+
+require 'jio'
+require 'fileutils'
+
+module JIO
+  class ShardedLogBench
+    THREADS = 4
+    APPENDS = 200
+    RECORD_SIZE = 256
+
+    attr_reader :results
+
+    def initialize(dir, options = {})
+      @dir = dir
+      @threads = options[:threads] || THREADS
+      @shards = options[:shards] || [1, @threads]
+      @appends = options[:appends] || APPENDS
+      @record_size = options[:record_size] || RECORD_SIZE
+      @results = []
+    end
+
+    def run(out = $stdout)
+      out.puts format_row(%w(shards threads appends seconds appends/s))
+      @shards.each do |shards|
+        seconds = measure(shards)
+        result = {:shards => shards, :seconds => seconds, :rate => @threads * @appends / seconds}
+        @results << result
+        out.puts format_row([shards, @threads, @threads * @appends, '%.3f' % seconds, result[:rate].round])
+      end
+      @results
+    end
+
+    # Throughput of the largest shard count over a single shard
+    def speedup
+      single = @results.detect{|r| r[:shards] == 1 }
+      single && @results.last[:rate] / single[:rate]
+    end
+
+    private
+    def measure(shards)
+      FileUtils.rm_rf(@dir)
+      log = JIO::ShardedLog.new(@dir, :shards => shards, :flags => 0)
+      record = 'r' * @record_size
+      keys = keys_for(log)
+      started = Time.now
+      (0...@threads).map do |t|
+        Thread.new{ @appends.times{ log.append(record, keys[t]) } }
+      end.each{|thread| thread.join }
+      Time.now - started
+    ensure
+      log.close if log
+    end
+
+    # One key per thread, assigned to shards round-robin
+    def keys_for(log)
+      (0...@threads).map do |t|
+        shard = t % log.shards.size
+        (0..10000).map{|i| "key-#{i}" }.detect{|key| log.shard_for(key) == shard }
+      end
+    end
+
+    def format_row(cols)
+      cols.map{|c| c.to_s }.zip([8, 8, 8, 9, 10]).map{|c, w| c.ljust(w) }.join(' ')
+    end
+  end
+end
+
+if $0 == __FILE__
+  threads = (ENV['THREADS'] || JIO::ShardedLogBench::THREADS).to_i
+  bench = JIO::ShardedLogBench.new(ENV['DIR'] || ::File.join(::File.dirname(__FILE__), '..', 'tmp', 'sharded_log'),
+    :threads => threads,
+    :shards => (ENV['SHARDS'] || "1,#{threads}").split(',').map{|s| s.to_i },
+    :appends => (ENV['APPENDS'] || JIO::ShardedLogBench::APPENDS).to_i,
+    :record_size => (ENV['RECORD_SIZE'] || JIO::ShardedLogBench::RECORD_SIZE).to_i)
+  bench.run
+  if ENV['MIN_SPEEDUP'] && bench.speedup
+    puts "speedup: %.2f" % bench.speedup
+    exit(1) if bench.speedup < ENV['MIN_SPEEDUP'].to_f
+  end
+end
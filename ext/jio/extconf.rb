@@ -89,17 +89,30 @@ unless File.directory?(libjio_path)
   Dir.chdir(vendor_path) do
     sys "tar xvzf libjio.tar.gz", "Could not extract the libjio archive!"
   end
+  # fixes to the vendored libjio, kept as patches against the archive
+  fail "The 'patch' utility is required to patch dependencies" if `which patch`.strip.empty?
+  Dir[(vendor_path + 'patches' + 'libjio-*.patch').to_s].sort.each do |patch|
+    sys "patch -p1 -d #{libjio_path} < #{patch}", "Could not apply #{File.basename(patch)}!"
+  end
 end
 
+# libfiu failure points for the crash recovery harness (bench/recovery.rb). Switching this on or off
+# requires a clean build, as libjio is built only once.
+fiu = enable_config('fiu', !!ENV['JIO_FIU'])
+
 # build libjio
 lib = libs_path + "libjio.#{LIBEXT}"
 Dir.chdir libjio_path do
-  sys "make DEBUG=1 PREFIX=#{dst_path} install", "libjio compile error!"
+  sys "make DEBUG=1 #{'FI=1 ' if fiu}PREFIX=#{dst_path} install", "libjio compile error!"
 end unless File.exist?(lib)
 
 dir_config('jio')
 
 have_func('rb_thread_blocking_region')
+have_func('rb_thread_call_without_gvl', 'ruby/thread.h') if have_header('ruby/thread.h')
+have_func('copy_file_range')
+have_header('sys/inotify.h')
+have_header('linux/fs.h')
 
 $INCFLAGS << " -I#{libjio_include_path}"
 
@@ -110,12 +123,19 @@ if defined?(RUBY_ENGINE) && RUBY_ENGINE =~ /rbx/ && RUBY_PLATFORM =~ /linux/
   CONFIG['LDSHARED'] = "#{CONFIG['LDSHARED']} -Wl,-rpath=#{libs_path.to_s}"
 end
 
+if fiu
+  fail "libfiu is required for --enable-fiu" unless have_header('fiu-control.h') && have_library('fiu', 'fiu_enable')
+  $defs << "-DFIU_ENABLE=1"
+end
+
 fail "Error compiling and linking libjio" unless have_library("jio")
 
 $defs << "-pedantic"
 # libjio requires large file support
 $defs << "-D_LARGEFILE_SOURCE=1"
 $defs << "-D_LARGEFILE64_SOURCE=1"
+# O_DIRECT is a GNU extension
+$defs << "-D_GNU_SOURCE=1"
 
 $CFLAGS << ' -Wall -funroll-loops'
 $CFLAGS << ' -Wextra -O0 -ggdb3' if ENV['DEBUG']
@@ -1,5 +1,329 @@
 #include "jio_ext.h"
 
+/*
+ *  O_DIRECT support. libjio applies transactions with unaligned writes through the page cache, so the
+ *  handle passed to jopen always stays buffered and only reads are direct: a second, O_DIRECT
+ *  descriptor serves them, bypassing the page cache entirely. Unaligned read ranges are widened to the
+ *  alignment boundary and copied out of a pooled bounce buffer. Every read through jio_file_pread goes
+ *  direct, so File#read, each_chunk, follow and JIO::Reader bypass the cache too. Written pages still
+ *  pass through the page cache, and are dropped from it by jio_direct_dontneed after every write path:
+ *  write, pwrite, transaction and multi file commits and rollbacks.
+ */
+static void *jio_direct_buf_get(jio_jfs_wrapper *file)
+{
+    void *buf = NULL;
+    pthread_mutex_lock(&file->lock);
+    if (file->pool_len > 0) buf = file->pool[--file->pool_len];
+    pthread_mutex_unlock(&file->lock);
+    if (buf != NULL) return buf;
+    if (posix_memalign(&buf, JIO_DIRECT_ALIGN, JIO_DIRECT_BUFSIZ) != 0) return NULL;
+    return buf;
+}
+
+static void jio_direct_buf_put(jio_jfs_wrapper *file, void *buf)
+{
+    pthread_mutex_lock(&file->lock);
+    if (file->pool_len < JIO_DIRECT_POOL_SIZE) {
+        file->pool[file->pool_len++] = buf;
+        buf = NULL;
+    }
+    pthread_mutex_unlock(&file->lock);
+    if (buf != NULL) free(buf);
+}
+
+static void jio_direct_close(jio_jfs_wrapper *file)
+{
+    pthread_mutex_lock(&file->lock);
+    while (file->pool_len > 0) free(file->pool[--file->pool_len]);
+    pthread_mutex_unlock(&file->lock);
+    if (file->direct_fd >= 0) close(file->direct_fd);
+    file->direct_fd = -1;
+}
+
+static ssize_t jio_direct_pread(jio_jfs_wrapper *file, char *dst, size_t count, off_t offset)
+{
+    void *buf;
+    ssize_t rv;
+    size_t skip, chunk, want, copied = 0;
+    off_t pos;
+    /* a zero length lock would extend to end of file */
+    if (count == 0) return 0;
+    buf = jio_direct_buf_get(file);
+    if (buf == NULL) return -1;
+    pos = offset & ~((off_t)JIO_DIRECT_ALIGN - 1);
+    skip = (size_t)(offset - pos);
+    if (plockf(file->fs->fd, F_LOCKR, offset, (off_t)count) == -1) {
+        jio_direct_buf_put(file, buf);
+        return -1;
+    }
+    while (copied < count) {
+        want = (skip + (count - copied) + JIO_DIRECT_ALIGN - 1) & ~((size_t)JIO_DIRECT_ALIGN - 1);
+        if (want > JIO_DIRECT_BUFSIZ) want = JIO_DIRECT_BUFSIZ;
+        rv = pread(file->direct_fd, buf, want, pos);
+        if (rv < 0) {
+            copied = (size_t)-1;
+            break;
+        }
+        if ((size_t)rv <= skip) break;
+        chunk = (size_t)rv - skip;
+        if (chunk > count - copied) chunk = count - copied;
+        memcpy(dst + copied, (char *)buf + skip, chunk);
+        copied += chunk;
+        pos += rv;
+        skip = 0;
+        if ((size_t)rv < want) break;
+    }
+    /* a plain F_UNLOCK would drop the locks of maps over the range too */
+    pthread_mutex_lock(&file->lock);
+    jio_map_unlock_range(file, NULL, offset, offset + (off_t)count);
+    pthread_mutex_unlock(&file->lock);
+    jio_direct_buf_put(file, buf);
+    return (ssize_t)copied;
+}
+
+/*
+ *  Drop written ranges from the page cache for O_DIRECT handles. This runs once the write or commit
+ *  has returned, and the kernel only releases clean pages - right away for regular transactions, but
+ *  only after File#sync for lingering ones, which drops the whole file.
+ */
+static inline void jio_direct_dontneed(jio_jfs_wrapper *file, off_t offset, off_t len)
+{
+    if (file->flags & JIO_FILE_DIRECT) posix_fadvise(file->fs->fd, offset, len, POSIX_FADV_DONTNEED);
+}
+
+/*
+ *  Same for the write operations of a committed or rolled back libjio transaction and a list of multi
+ *  file (or streamed) operations - only those on the file at idx from the latter, all of them if idx < 0.
+ */
+void jio_direct_dontneed_ops(jio_jfs_wrapper *file, struct operation *op, jio_multi_op *mop, long idx)
+{
+    if (!(file->flags & JIO_FILE_DIRECT)) return;
+    for (; op != NULL; op = op->next) {
+        if (op->direction == D_WRITE) jio_direct_dontneed(file, op->offset, (off_t)op->len);
+    }
+    for (; mop != NULL; mop = mop->next) {
+        if (idx < 0 || (long)mop->idx == idx) jio_direct_dontneed(file, mop->offset, (off_t)mop->len);
+    }
+}
+
+/*
+ *  Tail following. Every follower in the process shares a single non-blocking inotify descriptor,
+ *  and the kernel hands out one watch per inode and inotify instance, so followers of the same file
+ *  share a watch as well. A follower about to block drains pending events and bumps the generation
+ *  of the watches they refer to, which is how the other followers of a file learn about them. If its
+ *  own watch is unchanged, it registers as a waiter before releasing the mutex and blocks on an epoll
+ *  set of the inotify descriptor and its own eventfd, which any follower draining events for the watch
+ *  later signals - so events drained by another follower can't be lost in between. Without inotify,
+ *  followers poll every JIO_FOLLOW_POLL_USEC instead. The shared state is guarded by a mutex, as
+ *  followers may run in different Ractors.
+ */
+#define JIO_FOLLOW_POLL_USEC 10000
+
+static pthread_mutex_t jio_follow_lock = PTHREAD_MUTEX_INITIALIZER;
+static jio_follow_watch *jio_follow_watches = NULL;
+#ifdef HAVE_SYS_INOTIFY_H
+static int jio_inotify_fd = -1;
+#endif
+
+static jio_follow_watch *jio_follow_watch_add(jio_jfs_wrapper *file)
+{
+    jio_follow_watch *watch;
+    int wd = -1;
+    pthread_mutex_lock(&jio_follow_lock);
+#ifdef HAVE_SYS_INOTIFY_H
+    if (jio_inotify_fd < 0) jio_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (jio_inotify_fd < 0) {
+        pthread_mutex_unlock(&jio_follow_lock);
+        rb_sys_fail("inotify_init1");
+    }
+    wd = inotify_add_watch(jio_inotify_fd, file->fs->name, IN_MODIFY);
+    if (wd < 0) {
+        pthread_mutex_unlock(&jio_follow_lock);
+        rb_sys_fail("inotify_add_watch");
+    }
+#endif
+    for (watch = jio_follow_watches; watch != NULL; watch = watch->next) {
+        if (watch->wd == wd) break;
+    }
+    if (watch != NULL) {
+        watch->refs++;
+    } else {
+        watch = (jio_follow_watch *)malloc(sizeof(jio_follow_watch));
+        if (watch != NULL) {
+            watch->wd = wd;
+            watch->refs = 1;
+            watch->gen = 0;
+            watch->waiters = NULL;
+            watch->next = jio_follow_watches;
+            jio_follow_watches = watch;
+        }
+    }
+    pthread_mutex_unlock(&jio_follow_lock);
+    if (watch == NULL) rb_memerror();
+    return watch;
+}
+
+static void jio_follow_watch_release(jio_follow_watch *watch)
+{
+    jio_follow_watch **prev;
+    pthread_mutex_lock(&jio_follow_lock);
+    if (--watch->refs > 0) {
+        pthread_mutex_unlock(&jio_follow_lock);
+        return;
+    }
+    for (prev = &jio_follow_watches; *prev != watch; prev = &(*prev)->next);
+    *prev = watch->next;
+#ifdef HAVE_SYS_INOTIFY_H
+    inotify_rm_watch(jio_inotify_fd, watch->wd);
+#endif
+    pthread_mutex_unlock(&jio_follow_lock);
+    free(watch);
+}
+
+static unsigned long jio_follow_gen(jio_follow_watch *watch)
+{
+    unsigned long gen;
+    pthread_mutex_lock(&jio_follow_lock);
+    gen = watch->gen;
+    pthread_mutex_unlock(&jio_follow_lock);
+    return gen;
+}
+
+#ifdef HAVE_SYS_INOTIFY_H
+/*
+ *  Drains pending inotify events, bumping the generation of their watches and waking the followers
+ *  waiting on them. Called with jio_follow_lock held.
+ */
+static int jio_follow_drain()
+{
+    char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    struct inotify_event *ev;
+    jio_follow_watch *w;
+    jio_follow_waiter *waiter;
+    uint64_t one = 1;
+    ssize_t len;
+    char *ptr;
+    while ((len = read(jio_inotify_fd, buf, sizeof(buf))) > 0) {
+        for (ptr = buf; ptr < buf + len; ptr += sizeof(struct inotify_event) + ev->len) {
+            ev = (struct inotify_event *)ptr;
+            for (w = jio_follow_watches; w != NULL; w = w->next) {
+                if (w->wd != ev->wd) continue;
+                w->gen++;
+                for (waiter = w->waiters; waiter != NULL; waiter = waiter->next) {
+                    if (write(waiter->wake_fd, &one, sizeof(one)) != sizeof(one) && errno != EAGAIN) return -1;
+                }
+            }
+        }
+    }
+    return (len < 0 && errno != EAGAIN && errno != EINTR) ? -1 : 0;
+}
+
+static void jio_follow_unwait(jio_follow_args *args)
+{
+    jio_follow_waiter **prev;
+    uint64_t count;
+    if (!args->waiting) return;
+    pthread_mutex_lock(&jio_follow_lock);
+    for (prev = &args->watch->waiters; *prev != &args->waiter; prev = &(*prev)->next);
+    *prev = args->waiter.next;
+    args->waiting = 0;
+    pthread_mutex_unlock(&jio_follow_lock);
+    if (read(args->waiter.wake_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) rb_sys_fail("read");
+}
+#endif
+
+/*
+ *  Blocks until the watch moves past generation gen
+ */
+static void jio_follow_wait(jio_follow_args *args, unsigned long gen)
+{
+#ifdef HAVE_SYS_INOTIFY_H
+    int ret, err;
+    pthread_mutex_lock(&jio_follow_lock);
+    ret = jio_follow_drain();
+    err = errno;
+    if (ret == 0 && args->watch->gen == gen) {
+        args->waiter.next = args->watch->waiters;
+        args->watch->waiters = &args->waiter;
+        args->waiting = 1;
+    }
+    pthread_mutex_unlock(&jio_follow_lock);
+    if (ret != 0) {
+        errno = err;
+        rb_sys_fail("read");
+    }
+    if (!args->waiting) return;
+    rb_thread_wait_fd(args->poll_fd);
+    jio_follow_unwait(args);
+#else
+    struct timeval tv;
+    tv.tv_sec = 0;
+    tv.tv_usec = JIO_FOLLOW_POLL_USEC;
+    rb_thread_wait_for(tv);
+    pthread_mutex_lock(&jio_follow_lock);
+    args->watch->gen++;
+    pthread_mutex_unlock(&jio_follow_lock);
+#endif
+}
+
+/*
+ *  jpread releases its shared lock over the whole range once done, and as fcntl locks belong to the
+ *  process, with it the read locks of any maps of this handle overlapping the range. With live maps,
+ *  the range is read under a lock released only where no map covers it. O_DIRECT handles read through
+ *  their direct descriptor.
+ */
+ssize_t jio_file_pread(jio_jfs_wrapper *file, void *buf, size_t count, off_t offset)
+{
+    ssize_t rv;
+    int mapped, err;
+    if (file->flags & JIO_FILE_DIRECT) return jio_direct_pread(file, buf, count, offset);
+    pthread_mutex_lock(&file->lock);
+    mapped = (file->maps != NULL);
+    pthread_mutex_unlock(&file->lock);
+    if (!mapped) {
+        rv = jpread(file->fs, buf, count, offset);
+        /* another thread may have mapped part of the range meanwhile */
+        err = jio_map_relock(file);
+        if (err != 0) {
+            errno = err;
+            return -1;
+        }
+        return rv;
+    }
+    if (count == 0) return 0;
+    if (plockf(file->fs->fd, F_LOCKR, offset, (off_t)count) == -1) return -1;
+    rv = spread(file->fs->fd, buf, count, offset);
+    pthread_mutex_lock(&file->lock);
+    jio_map_unlock_range(file, NULL, offset, offset + (off_t)count);
+    pthread_mutex_unlock(&file->lock);
+    return rv;
+}
+
+/*
+ *  Handles are shared between threads and, frozen, between Ractors. Every operation on the jfs holds
+ *  the handle in use, so that close can't free it from under them - it raises while the handle is held
+ *  instead. Holding fails once the handle is closed.
+ */
+int jio_file_hold(jio_jfs_wrapper *file)
+{
+    int ret = 0;
+    pthread_mutex_lock(&file->lock);
+    if (file->flags & JIO_FILE_CLOSED) {
+        ret = -1;
+    } else {
+        file->users++;
+    }
+    pthread_mutex_unlock(&file->lock);
+    return ret;
+}
+
+void jio_file_release(jio_jfs_wrapper *file)
+{
+    pthread_mutex_lock(&file->lock);
+    file->users--;
+    pthread_mutex_unlock(&file->lock);
+}
+
 /*
  *  GC callbacks for JIO::File
  */
@@ -8,16 +332,72 @@ static void rb_jio_free_file(void *ptr)
     jio_jfs_wrapper *file = (jio_jfs_wrapper *)ptr;
     if (file) {
         if (file->fs != NULL && !(file->flags & JIO_FILE_CLOSED)) jclose(file->fs);
+        jio_map_detach_all(file);
+        jio_direct_close(file);
+        jio_dirty_close(file);
+        free(file->path);
+        pthread_mutex_destroy(&file->lock);
         xfree(file);
     }
 }
 
+/*
+ *  Resolves the directory of a path the file may not exist at yet. libjio derives the journal directory
+ *  from the name it's given and multi file transaction records name their files, so both stay valid
+ *  whatever the working directory later. Returns a malloc'ed path, NULL with errno set on failure.
+ */
+static char *jio_absolute_path(const char *name)
+{
+    char dir[PATH_MAX], *resolved, *path;
+    const char *base = strrchr(name, '/');
+    size_t len;
+    if (base == NULL) {
+        strcpy(dir, ".");
+        base = name;
+    } else {
+        len = (base == name) ? 1 : (size_t)(base - name);
+        if (len >= PATH_MAX) {
+            errno = ENAMETOOLONG;
+            return NULL;
+        }
+        memcpy(dir, name, len);
+        dir[len] = '\0';
+        base++;
+    }
+    resolved = realpath(dir, NULL);
+    if (resolved == NULL) return NULL;
+    len = strlen(resolved) + strlen(base) + 2;
+    if (len > PATH_MAX) {
+        free(resolved);
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+    path = malloc(len);
+    if (path != NULL) snprintf(path, len, "%s%s%s", resolved, strcmp(resolved, "/") == 0 ? "" : "/", base);
+    free(resolved);
+    return path;
+}
+
+#ifdef RUBY_TYPED_FROZEN_SHAREABLE
+/*
+ *  Frozen handles can be shared between Ractors. libjio guards a jfs with its own mutexes and the
+ *  wrapper's buffer pool and map list are guarded by file->lock.
+ */
+const rb_data_type_t jio_file_type = {
+    "JIO::File",
+    {0, rb_jio_free_file, 0,},
+    0, 0,
+    RUBY_TYPED_FROZEN_SHAREABLE
+};
+#endif
+
 /*
  *  call-seq:
  *     JIO.open("/path/file", JIO::CREAT | JIO::RDWR, 0600, JIO::J_LINGER)    =>  JIO::File
  *
  *  Returns a handle to a journaled file instance. Same semantics as the UNIX open(2) libc call, with
- *  an additional one for libjio specific flags.
+ *  an additional one for libjio specific flags. With JIO::DIRECT, reads bypass the page cache. Writes
+ *  are still applied through it, and written ranges are dropped from it once on disk. JIO::J_TRACK logs the regions written for File#snapshot_to and File#export_since.
  *
  * === Examples
  *     JIO.open("/path/file", JIO::CREAT | JIO::RDWR, 0600, JIO::J_LINGER)    =>  JIO::File
@@ -27,20 +407,61 @@ static void rb_jio_free_file(void *ptr)
 static VALUE rb_jio_s_open(JIO_UNUSED VALUE jio, VALUE path, VALUE flags, VALUE mode, VALUE jflags)
 {
     VALUE obj;
+    int oflags;
     jio_jfs_wrapper *file = NULL;
     Check_Type(path, T_STRING);
     Check_Type(flags, T_FIXNUM);
     Check_Type(mode, T_FIXNUM);
     Check_Type(jflags, T_FIXNUM);
+    oflags = FIX2INT(flags);
+#ifdef RUBY_TYPED_FROZEN_SHAREABLE
+    obj = TypedData_Make_Struct(rb_cJioFile, jio_jfs_wrapper, &jio_file_type, file);
+#else
     obj = Data_Make_Struct(rb_cJioFile, jio_jfs_wrapper, 0, rb_jio_free_file, file);
+#endif
+    pthread_mutex_init(&file->lock, NULL);
+    file->flags = 0;
+    file->path = NULL;
+    file->direct_fd = -1;
+    file->dirty_fd = -1;
+    file->pool_len = 0;
+    file->wgen = 0;
+    file->maps = NULL;
+    file->users = 0;
+#ifdef O_DIRECT
+    if (oflags & O_DIRECT) {
+        oflags &= ~O_DIRECT;
+        file->flags |= JIO_FILE_DIRECT;
+    }
+#endif
+    file->path = jio_absolute_path(RSTRING_PTR(path));
+    if (file->path == NULL) {
+        file->flags |= JIO_FILE_CLOSED;
+        rb_sys_fail(RSTRING_PTR(path));
+    }
     TRAP_BEG;
-    file->fs = jopen(RSTRING_PTR(path), FIX2INT(flags), FIX2INT(mode), FIX2UINT(jflags));
+    file->fs = jopen(file->path, oflags, FIX2INT(mode), FIX2UINT(jflags) & ~JIO_J_TRACK);
     TRAP_END;
     if (file->fs == NULL) {
-        xfree(file);
+        file->flags |= JIO_FILE_CLOSED;
         rb_sys_fail("jopen");
     }
-    file->flags = 0;
+#ifdef O_DIRECT
+    if (file->flags & JIO_FILE_DIRECT) {
+        file->direct_fd = open(file->path, O_RDONLY | O_DIRECT);
+        if (file->direct_fd < 0) {
+            jclose(file->fs);
+            file->flags |= JIO_FILE_CLOSED;
+            rb_sys_fail("open(O_DIRECT)");
+        }
+    }
+#endif
+    if (jio_dirty_open(file, (FIX2UINT(jflags) & JIO_J_TRACK) != 0) != 0) {
+        jio_direct_close(file);
+        jclose(file->fs);
+        file->flags |= JIO_FILE_CLOSED;
+        rb_sys_fail("open dirty log");
+    }
     rb_obj_call_init(obj, 0, NULL);
     return obj;
 }
@@ -57,12 +478,20 @@ static VALUE rb_jio_s_open(JIO_UNUSED VALUE jio, VALUE path, VALUE flags, VALUE
  *
 */
 
+static void *jio_file_sync_nogvl(void *ptr)
+{
+    return (void *)(intptr_t)jsync((jfs_t *)ptr);
+}
+
 static VALUE rb_jio_file_sync(VALUE obj)
 {
+    int ret;
     JioGetFile(obj);
-    TRAP_BEG;
-    return (jsync(file->fs) == 0) ? Qtrue : Qfalse;
-    TRAP_END;
+    JioHoldFile(file);
+    ret = (int)(intptr_t)jio_blocking_call(jio_file_sync_nogvl, file->fs);
+    if (ret == 0) jio_direct_dontneed(file, 0, 0);
+    jio_file_release(file);
+    return (ret == 0) ? Qtrue : Qfalse;
 }
 
 /*
@@ -70,7 +499,8 @@ static VALUE rb_jio_file_sync(VALUE obj)
  *     file.close    =>  boolean
  *
  *  After a call to this method, the memory allocated for the open file will be freed. If there was an
- *  autosync thread started for this file, it will be stopped.
+ *  autosync thread started for this file, it will be stopped. Raises IOError if the file is already
+ *  closed, or still in use by another thread, Ractor or an each_chunk block.
  *
  * === Examples
  *     file.close    =>  boolean
@@ -79,12 +509,23 @@ static VALUE rb_jio_file_sync(VALUE obj)
 
 static VALUE rb_jio_file_close(VALUE obj)
 {
+    int ret, closed, users;
     JioGetFile(obj);
+    pthread_mutex_lock(&file->lock);
+    closed = file->flags & JIO_FILE_CLOSED;
+    users = file->users;
+    if (!closed && users == 0) file->flags |= JIO_FILE_CLOSED;
+    pthread_mutex_unlock(&file->lock);
+    if (closed) rb_raise(rb_eIOError, "closed JIO::File");
+    if (users > 0) rb_raise(rb_eIOError, "JIO::File in use");
+    /* maps unmapped from now on leave the jfs alone, and jclose frees it even when it fails */
+    jio_map_detach_all(file);
     TRAP_BEG;
-    if (jclose(file->fs) != 0) return Qfalse;
+    ret = jclose(file->fs);
     TRAP_END;
-    file->flags |= JIO_FILE_CLOSED;
-    return Qtrue;
+    jio_direct_close(file);
+    jio_dirty_close(file);
+    return (ret == 0) ? Qtrue : Qfalse;
 }
 
 /*
@@ -100,11 +541,15 @@ static VALUE rb_jio_file_close(VALUE obj)
 
 static VALUE rb_jio_file_move_journal(VALUE obj, VALUE path)
 {
+    int ret;
     JioGetFile(obj);
     Check_Type(path, T_STRING);
+    JioHoldFile(file);
     TRAP_BEG;
-    return (jmove_journal(file->fs, RSTRING_PTR(path)) == 0) ? Qtrue : Qfalse;
+    ret = jmove_journal(file->fs, RSTRING_PTR(path));
     TRAP_END;
+    jio_file_release(file);
+    return (ret == 0) ? Qtrue : Qfalse;
 }
 
 /*
@@ -121,12 +566,16 @@ static VALUE rb_jio_file_move_journal(VALUE obj, VALUE path)
 
 static VALUE rb_jio_file_autosync(VALUE obj, VALUE max_seconds, VALUE max_bytes)
 {
+    int ret;
     JioGetFile(obj);
     Check_Type(max_seconds, T_FIXNUM);
     Check_Type(max_bytes, T_FIXNUM);
+    JioHoldFile(file);
     TRAP_BEG;
-    return (jfs_autosync_start(file->fs, (time_t)FIX2LONG(max_seconds), (size_t)FIX2LONG(max_bytes)) == 0) ? Qtrue : Qfalse;
+    ret = jfs_autosync_start(file->fs, (time_t)FIX2LONG(max_seconds), (size_t)FIX2LONG(max_bytes));
     TRAP_END;
+    jio_file_release(file);
+    return (ret == 0) ? Qtrue : Qfalse;
 }
 
 /*
@@ -142,10 +591,14 @@ static VALUE rb_jio_file_autosync(VALUE obj, VALUE max_seconds, VALUE max_bytes)
 
 static VALUE rb_jio_file_stop_autosync(VALUE obj)
 {
+    int ret;
     JioGetFile(obj);
+    JioHoldFile(file);
     TRAP_BEG;
-    return (jfs_autosync_stop(file->fs) == 0) ? Qtrue : Qfalse;
+    ret = jfs_autosync_stop(file->fs);
     TRAP_END;
+    jio_file_release(file);
+    return (ret == 0) ? Qtrue : Qfalse;
 }
 
 /*
@@ -164,14 +617,32 @@ static VALUE rb_jio_file_read(VALUE obj, VALUE length)
     ssize_t bytes;
     char *buf = NULL;
     ssize_t len;
+    int relock;
     JioGetFile(obj);
     AssertLength(length);
     len = (ssize_t)FIX2LONG(length);
     buf = xmalloc(len + 1);
     if (buf == NULL) rb_memerror();
+    if (jio_file_hold(file) != 0) {
+        xfree(buf);
+        rb_raise(rb_eIOError, "closed JIO::File");
+    }
     TRAP_BEG;
-    bytes = jread(file->fs, buf, len);
+    if (file->maps != NULL || (file->flags & JIO_FILE_DIRECT)) {
+        /* jread at the file pointer would release the maps' locks over the range, or read buffered */
+        off_t pos = lseek(file->fs->fd, 0, SEEK_CUR);
+        bytes = (pos < 0) ? -1 : jio_file_pread(file, buf, (size_t)len, pos);
+        if (bytes > 0) lseek(file->fs->fd, pos + bytes, SEEK_SET);
+    } else {
+        bytes = jread(file->fs, buf, len);
+        relock = jio_map_relock(file);
+        if (relock != 0) {
+            errno = relock;
+            bytes = -1;
+        }
+    }
     TRAP_END;
+    jio_file_release(file);
     if (bytes == -1) {
        xfree(buf);
        rb_sys_fail("jread");
@@ -183,7 +654,8 @@ static VALUE rb_jio_file_read(VALUE obj, VALUE length)
  *  call-seq:
  *     file.pread(10, 10)    =>  String
  *
- *  Reads from a libjio file handle at a given offset. Works just like UNIX pread(2)
+ *  Reads from a libjio file handle at a given offset. Works just like UNIX pread(2). Handles opened
+ *  with JIO::DIRECT bypass the page cache and return short reads at end of file.
  *
  * === Examples
  *     file.pread(10, 10)    =>  String
@@ -192,6 +664,7 @@ static VALUE rb_jio_file_read(VALUE obj, VALUE length)
 
 static VALUE rb_jio_file_pread(VALUE obj, VALUE length, VALUE offset)
 {
+    VALUE str;
     ssize_t bytes;
     char *buf = NULL;
     ssize_t len;
@@ -201,14 +674,22 @@ static VALUE rb_jio_file_pread(VALUE obj, VALUE length, VALUE offset)
     len = (ssize_t)FIX2LONG(length);
     buf = xmalloc(len + 1);
     if (buf == NULL) rb_memerror();
+    if (jio_file_hold(file) != 0) {
+        xfree(buf);
+        rb_raise(rb_eIOError, "closed JIO::File");
+    }
     TRAP_BEG;
-    bytes = jpread(file->fs, buf, len, (off_t)NUM2OFFT(offset));
+    bytes = jio_file_pread(file, buf, len, (off_t)NUM2OFFT(offset));
     TRAP_END;
+    jio_file_release(file);
     if (bytes == -1) {
        xfree(buf);
        rb_sys_fail("jpread");
     }
-    return JioEncode(rb_str_new(buf, (long)len));
+    if (file->flags & JIO_FILE_DIRECT) len = bytes;
+    str = JioEncode(rb_str_new(buf, (long)len));
+    xfree(buf);
+    return str;
 }
 
 /*
@@ -225,12 +706,28 @@ static VALUE rb_jio_file_pread(VALUE obj, VALUE length, VALUE offset)
 static VALUE rb_jio_file_write(VALUE obj, VALUE buf)
 {
     ssize_t bytes;
+    off_t pos;
+    int relock;
     JioGetFile(obj);
     Check_Type(buf, T_STRING);
+    JioHoldFile(file);
+    JioFileWritten(file);
+    if (jio_dirty_note_write(file, -1, (size_t)RSTRING_LEN(buf), 1) != 0) {
+        jio_file_release(file);
+        rb_sys_fail("dirty log");
+    }
     TRAP_BEG;
     bytes = jwrite(file->fs, RSTRING_PTR(buf), (size_t)RSTRING_LEN(buf));
     TRAP_END;
+    relock = jio_map_relock(file);
+    if (bytes != -1) {
+        pos = lseek(file->fs->fd, 0, SEEK_CUR) - bytes;
+        jio_dirty_note_write(file, pos, (size_t)bytes, 0);
+        jio_direct_dontneed(file, pos, (off_t)bytes);
+    }
+    jio_file_release(file);
     if (bytes == -1) rb_sys_fail("jwrite");
+    jio_map_check_relock(relock);
     return INT2NUM(bytes);
 }
 
@@ -248,13 +745,27 @@ static VALUE rb_jio_file_write(VALUE obj, VALUE buf)
 static VALUE rb_jio_file_pwrite(VALUE obj, VALUE buf, VALUE offset)
 {
     ssize_t bytes;
+    int relock;
     JioGetFile(obj);
     Check_Type(buf, T_STRING);
     AssertOffset(offset);
+    JioHoldFile(file);
+    JioFileWritten(file);
+    if (jio_dirty_note_write(file, (off_t)NUM2OFFT(offset), (size_t)RSTRING_LEN(buf), 1) != 0) {
+        jio_file_release(file);
+        rb_sys_fail("dirty log");
+    }
     TRAP_BEG;
     bytes = jpwrite(file->fs, RSTRING_PTR(buf), (size_t)RSTRING_LEN(buf), (off_t)NUM2OFFT(offset));
     TRAP_END;
+    relock = jio_map_relock(file);
+    if (bytes != -1) {
+        jio_dirty_note_write(file, (off_t)NUM2OFFT(offset), (size_t)bytes, 0);
+        jio_direct_dontneed(file, (off_t)NUM2OFFT(offset), (off_t)bytes);
+    }
+    jio_file_release(file);
     if (bytes == -1) rb_sys_fail("jpwrite");
+    jio_map_check_relock(relock);
     return INT2NUM(bytes);
 }
 
@@ -275,9 +786,11 @@ static VALUE rb_jio_file_lseek(VALUE obj, VALUE offset, VALUE whence)
     JioGetFile(obj);
     AssertOffset(offset);
     Check_Type(whence, T_FIXNUM);
+    JioHoldFile(file);
     TRAP_BEG;
     off = jlseek(file->fs, (off_t)NUM2OFFT(offset), FIX2INT(whence));
     TRAP_END;
+    jio_file_release(file);
     if (off == -1) rb_sys_fail("jlseek");
     return OFFT2NUM(off);
 }
@@ -296,12 +809,26 @@ static VALUE rb_jio_file_lseek(VALUE obj, VALUE offset, VALUE whence)
 static VALUE rb_jio_file_truncate(VALUE obj, VALUE length)
 {
     off_t len;
+    int relock;
+    jio_extent ext;
     JioGetFile(obj);
     AssertLength(length);
+    ext.offset = (uint64_t)NUM2OFFT(length);
+    ext.len = JIO_DIRTY_TRUNCATE;
+    JioHoldFile(file);
+    JioFileWritten(file);
+    if (jio_dirty_note(file, &ext, 1, 1) != 0) {
+        jio_file_release(file);
+        rb_sys_fail("dirty log");
+    }
     TRAP_BEG;
     len = jtruncate(file->fs, (off_t)NUM2OFFT(length));
     TRAP_END;
+    relock = jio_map_relock(file);
+    if (len != -1) jio_dirty_note(file, &ext, 1, 0);
+    jio_file_release(file);
     if (len == -1) rb_sys_fail("jtruncate");
+    jio_map_check_relock(relock);
     return OFFT2NUM(len);
 }
 
@@ -320,9 +847,11 @@ static VALUE rb_jio_file_fileno(VALUE obj)
 {
     int fd;
     JioGetFile(obj);
+    JioHoldFile(file);
     TRAP_BEG;
     fd = jfileno(file->fs);
     TRAP_END;
+    jio_file_release(file);
     if (fd == -1) rb_sys_fail("jfileno");
     return INT2NUM(fd);
 }
@@ -341,9 +870,11 @@ static VALUE rb_jio_file_fileno(VALUE obj)
 static VALUE rb_jio_file_rewind(VALUE obj)
 {
     JioGetFile(obj);
+    JioHoldFile(file);
     TRAP_BEG;
     jrewind(file->fs);
     TRAP_END;
+    jio_file_release(file);
     return Qnil;
 }
 
@@ -362,9 +893,11 @@ static VALUE rb_jio_file_tell(VALUE obj)
 {
     long size;
     JioGetFile(obj);
+    JioHoldFile(file);
     TRAP_BEG;
     size = jftell(file->fs);
     TRAP_END;
+    jio_file_release(file);
     if (size == -1) rb_sys_fail("jftell");
     return INT2NUM(size);
 }
@@ -382,10 +915,14 @@ static VALUE rb_jio_file_tell(VALUE obj)
 
 static VALUE rb_jio_file_eof_p(VALUE obj)
 {
+    int ret;
     JioGetFile(obj);
+    JioHoldFile(file);
     TRAP_BEG;
-    return (jfeof(file->fs) != 0) ? Qtrue : Qfalse;
+    ret = jfeof(file->fs);
     TRAP_END;
+    jio_file_release(file);
+    return (ret != 0) ? Qtrue : Qfalse;
 }
 
 /*
@@ -403,9 +940,11 @@ static VALUE rb_jio_file_error_p(VALUE obj)
 {
     int res;
     JioGetFile(obj);
+    JioHoldFile(file);
     TRAP_BEG;
     res = jferror(file->fs);
     TRAP_END;
+    jio_file_release(file);
     if (res == 0) return Qfalse;
     return INT2NUM(res);
 }
@@ -424,12 +963,307 @@ static VALUE rb_jio_file_error_p(VALUE obj)
 static VALUE rb_jio_file_clearerr(VALUE obj)
 {
     JioGetFile(obj);
+    JioHoldFile(file);
     TRAP_BEG;
     jclearerr(file->fs);
     TRAP_END;
+    jio_file_release(file);
     return Qnil;
 }
 
+/*
+ *  Reads the next chunk of committed data past the follower's offset. The read takes a shared lock on
+ *  the range, which waits out any transaction of another process still applying to it, and the range
+ *  never extends past the file size observed beforehand.
+ */
+static VALUE jio_follow_read(jio_follow_args *args)
+{
+    struct stat st;
+    VALUE str;
+    ssize_t bytes;
+    size_t len;
+    /* the handle is only held per read, so closing it ends the follow loop */
+    if (jio_file_hold(args->file) != 0) return Qnil;
+    if (fstat(args->file->fs->fd, &st) != 0) {
+        jio_file_release(args->file);
+        rb_sys_fail("fstat");
+    }
+    if (st.st_size <= args->offset) {
+        jio_file_release(args->file);
+        return Qnil;
+    }
+    len = (size_t)(st.st_size - args->offset);
+    if (len > JIO_FOLLOW_BUFSIZ) len = JIO_FOLLOW_BUFSIZ;
+    str = rb_str_new(NULL, (long)len);
+    TRAP_BEG;
+    bytes = jio_file_pread(args->file, RSTRING_PTR(str), len, args->offset);
+    TRAP_END;
+    jio_file_release(args->file);
+    if (bytes == -1) rb_sys_fail("jpread");
+    if (bytes == 0) return Qnil;
+    rb_str_resize(str, (long)bytes);
+    args->offset += bytes;
+    return JioEncode(str);
+}
+
+static VALUE jio_follow_loop(VALUE ptr)
+{
+    jio_follow_args *args = (jio_follow_args *)ptr;
+    unsigned long gen;
+    VALUE chunk;
+    while (!(args->file->flags & JIO_FILE_CLOSED)) {
+        gen = jio_follow_gen(args->watch);
+        chunk = jio_follow_read(args);
+        if (!NIL_P(chunk)) {
+            rb_yield(chunk);
+        } else {
+            jio_follow_wait(args, gen);
+        }
+    }
+    return Qnil;
+}
+
+static VALUE jio_follow_ensure(VALUE ptr)
+{
+    jio_follow_args *args = (jio_follow_args *)ptr;
+#ifdef HAVE_SYS_INOTIFY_H
+    /* interrupted while blocked */
+    jio_follow_unwait(args);
+    close(args->poll_fd);
+    close(args->waiter.wake_fd);
+#endif
+    jio_follow_watch_release(args->watch);
+    return Qnil;
+}
+
+#ifdef HAVE_SYS_INOTIFY_H
+static int jio_follow_poll_fd(int wake_fd)
+{
+    struct epoll_event ev;
+    int fd = epoll_create1(EPOLL_CLOEXEC);
+    if (fd < 0) return -1;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    if (epoll_ctl(fd, EPOLL_CTL_ADD, jio_inotify_fd, &ev) != 0 || epoll_ctl(fd, EPOLL_CTL_ADD, wake_fd, &ev) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+#endif
+
+/*
+ *  call-seq:
+ *     file.follow(0){|chunk| }    =>  nil
+ *
+ *  Yields data appended to the file from a given offset onwards as it becomes visible, blocking the
+ *  current thread in between. Transactions hold write locks on all their ranges while applying, so
+ *  data of a transaction still being applied by another process isn't delivered. That doesn't cover
+ *  transactions committed with JIO::J_NOLOCK, nor writers in the same process, which share its fcntl
+ *  locks. Wakeups are driven by inotify, with all followers of a file sharing a single watch. Returns
+ *  an Enumerator if no block is given, and stops once the file is closed.
+ *
+ * === Examples
+ *     file.follow(0){|chunk| }    =>  nil
+ *     file.follow(1024).first(2)    =>  [String, String]
+ *
+*/
+
+static VALUE rb_jio_file_follow(int argc, VALUE *argv, VALUE obj)
+{
+    VALUE offset;
+    jio_follow_args args;
+    JioGetFile(obj);
+    RETURN_ENUMERATOR(obj, argc, argv);
+    rb_scan_args(argc, argv, "01", &offset);
+    if (NIL_P(offset)) offset = jio_zero;
+    AssertOffset(offset);
+    if (file->flags & JIO_FILE_CLOSED) rb_raise(rb_eIOError, "closed JIO::File");
+    args.file = file;
+    args.offset = (off_t)NUM2OFFT(offset);
+    args.watch = jio_follow_watch_add(file);
+    args.waiting = 0;
+#ifdef HAVE_SYS_INOTIFY_H
+    args.waiter.wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    args.poll_fd = (args.waiter.wake_fd < 0) ? -1 : jio_follow_poll_fd(args.waiter.wake_fd);
+    if (args.poll_fd < 0) {
+        if (args.waiter.wake_fd >= 0) close(args.waiter.wake_fd);
+        jio_follow_watch_release(args.watch);
+        rb_sys_fail("follow");
+    }
+#endif
+    rb_ensure(jio_follow_loop, (VALUE)&args, jio_follow_ensure, (VALUE)&args);
+    return Qnil;
+}
+
+/*
+ *  Sequential scans. A native thread reads chunks ahead of the consumer into a ring of reusable
+ *  buffers, hinting the kernel with POSIX_FADV_WILLNEED for the chunks after the one it's reading,
+ *  and signals each filled slot through a pipe so the consumer can wait without blocking other Ruby
+ *  threads. A short or failed read ends the scan.
+ */
+static void *jio_readahead_run(void *ptr)
+{
+    jio_readahead *ra = (jio_readahead *)ptr;
+    ssize_t len;
+    int slot, err, stop;
+    for (;;) {
+        pthread_mutex_lock(&ra->lock);
+        while (ra->filled == ra->slots && !ra->stop) pthread_cond_wait(&ra->cond, &ra->lock);
+        slot = ra->head;
+        stop = ra->stop;
+        pthread_mutex_unlock(&ra->lock);
+        if (stop) break;
+        posix_fadvise(ra->fs->fd, ra->offset + (off_t)ra->size, (off_t)(ra->size * ra->slots), POSIX_FADV_WILLNEED);
+        len = jio_file_pread(ra->file, ra->bufs[slot], ra->size, ra->offset);
+        err = errno;
+        pthread_mutex_lock(&ra->lock);
+        ra->lens[slot] = len;
+        ra->errs[slot] = err;
+        ra->head = (ra->head + 1) % ra->slots;
+        ra->filled++;
+        pthread_mutex_unlock(&ra->lock);
+        if (write(ra->notify[1], "", 1) != 1) break;
+        if (len < (ssize_t)ra->size) break;
+        ra->offset += len;
+    }
+    return NULL;
+}
+
+static VALUE jio_readahead_free(VALUE ptr)
+{
+    jio_readahead *ra = (jio_readahead *)ptr;
+    int i;
+    if (ra->started) {
+        pthread_mutex_lock(&ra->lock);
+        ra->stop = 1;
+        pthread_cond_signal(&ra->cond);
+        pthread_mutex_unlock(&ra->lock);
+        pthread_join(ra->thread, NULL);
+    }
+    jio_file_release(ra->file);
+    pthread_mutex_destroy(&ra->lock);
+    pthread_cond_destroy(&ra->cond);
+    if (ra->notify[0] >= 0) close(ra->notify[0]);
+    if (ra->notify[1] >= 0) close(ra->notify[1]);
+    if (ra->bufs != NULL) {
+        for (i = 0; i < ra->slots; i++) {
+            if (ra->bufs[i] != NULL) xfree(ra->bufs[i]);
+        }
+        xfree(ra->bufs);
+    }
+    if (ra->lens != NULL) xfree(ra->lens);
+    if (ra->errs != NULL) xfree(ra->errs);
+    return Qnil;
+}
+
+/*
+ *  Consumer side. The yielded String is reused across chunks, so no allocation happens per chunk.
+ */
+static VALUE jio_readahead_each(VALUE ptr)
+{
+    jio_readahead *ra = (jio_readahead *)ptr;
+    VALUE str;
+    ssize_t len;
+    int i, slot, err;
+    char drain[64];
+    ra->bufs = ALLOC_N(char *, ra->slots);
+    for (i = 0; i < ra->slots; i++) ra->bufs[i] = NULL;
+    for (i = 0; i < ra->slots; i++) ra->bufs[i] = ALLOC_N(char, ra->size);
+    ra->lens = ALLOC_N(ssize_t, ra->slots);
+    ra->errs = ALLOC_N(int, ra->slots);
+    if (pipe(ra->notify) != 0) rb_sys_fail("pipe");
+    fcntl(ra->notify[0], F_SETFL, fcntl(ra->notify[0], F_GETFL) | O_NONBLOCK);
+    if ((err = pthread_create(&ra->thread, NULL, jio_readahead_run, ra)) != 0) {
+        errno = err;
+        rb_sys_fail("pthread_create");
+    }
+    ra->started = 1;
+    str = rb_str_buf_new((long)ra->size);
+    for (;;) {
+        pthread_mutex_lock(&ra->lock);
+        while (ra->filled == 0) {
+            pthread_mutex_unlock(&ra->lock);
+            rb_thread_wait_fd(ra->notify[0]);
+            while (read(ra->notify[0], drain, sizeof(drain)) > 0);
+            pthread_mutex_lock(&ra->lock);
+        }
+        slot = ra->tail;
+        len = ra->lens[slot];
+        err = ra->errs[slot];
+        pthread_mutex_unlock(&ra->lock);
+        if (len < 0) {
+            errno = err;
+            rb_sys_fail("jpread");
+        }
+        if (len == 0) break;
+        rb_str_modify(str);
+        rb_str_resize(str, (long)len);
+        memcpy(RSTRING_PTR(str), ra->bufs[slot], (size_t)len);
+        pthread_mutex_lock(&ra->lock);
+        ra->tail = (ra->tail + 1) % ra->slots;
+        ra->filled--;
+        pthread_cond_signal(&ra->cond);
+        pthread_mutex_unlock(&ra->lock);
+        rb_yield(JioEncode(str));
+        if (len < (ssize_t)ra->size) break;
+    }
+    return Qnil;
+}
+
+/*
+ *  call-seq:
+ *     file.each_chunk(65536, :readahead => 4){|chunk| }    =>  JIO::File
+ *
+ *  Yields the file's contents in chunks of the given size, from offset 0 or the :offset option
+ *  onwards. A native thread keeps up to :readahead chunks (at least 2, 4 by default) read ahead of
+ *  the block. The same String instance is yielded for every chunk - dup it to keep a chunk around.
+ *  The file can't be closed until the scan ends. Returns an Enumerator if no block is given.
+ *
+ * === Examples
+ *     file.each_chunk(65536){|chunk| }    =>  JIO::File
+ *     file.each_chunk(1024 * 1024, :readahead => 8, :offset => 4096){|chunk| }    =>  JIO::File
+ *
+*/
+
+static VALUE rb_jio_file_each_chunk(int argc, VALUE *argv, VALUE obj)
+{
+    VALUE size, opts, slots, offset;
+    jio_readahead ra;
+    JioGetFile(obj);
+    RETURN_ENUMERATOR(obj, argc, argv);
+    rb_scan_args(argc, argv, "11", &size, &opts);
+    AssertLength(size);
+    if (size == jio_zero) rb_raise(rb_eArgError, "chunk size must be > 0");
+    slots = offset = Qnil;
+    if (!NIL_P(opts)) {
+        Check_Type(opts, T_HASH);
+        slots = rb_hash_aref(opts, ID2SYM(rb_intern("readahead")));
+        offset = rb_hash_aref(opts, ID2SYM(rb_intern("offset")));
+    }
+    if (NIL_P(slots)) slots = INT2FIX(JIO_READAHEAD_SLOTS);
+    if (NIL_P(offset)) offset = jio_zero;
+    Check_Type(slots, T_FIXNUM);
+    AssertOffset(offset);
+    MEMZERO(&ra, jio_readahead, 1);
+    ra.fs = file->fs;
+    ra.file = file;
+    ra.size = (size_t)FIX2LONG(size);
+    ra.slots = FIX2INT(slots) < 2 ? 2 : FIX2INT(slots);
+    ra.offset = (off_t)NUM2OFFT(offset);
+    ra.notify[0] = ra.notify[1] = -1;
+    pthread_mutex_init(&ra.lock, NULL);
+    pthread_cond_init(&ra.cond, NULL);
+    /* held until the readahead thread is joined, released by jio_readahead_free */
+    if (jio_file_hold(file) != 0) {
+        pthread_mutex_destroy(&ra.lock);
+        pthread_cond_destroy(&ra.cond);
+        rb_raise(rb_eIOError, "closed JIO::File");
+    }
+    rb_ensure(jio_readahead_each, (VALUE)&ra, jio_readahead_free, (VALUE)&ra);
+    return obj;
+}
+
 /*
  *  call-seq:
  *     file.transaction(JIO::J_LINGER)    =>  JIO::Transaction
@@ -448,15 +1282,19 @@ VALUE rb_jio_file_new_transaction(VALUE obj, VALUE flags)
     JioGetFile(obj);
     Check_Type(flags, T_FIXNUM);
     transaction = Data_Make_Struct(rb_cJioTransaction, jio_jtrans_wrapper, rb_jio_mark_transaction, rb_jio_free_transaction, trans);
+    JioHoldFile(file);
     TRAP_BEG;
     trans->trans = jtrans_new(file->fs, FIX2INT(flags));
     TRAP_END;
+    jio_file_release(file);
     if (trans->trans == NULL) {
         xfree(trans);
         rb_sys_fail("jtrans_new");
     }
+    trans->file = obj;
     trans->views = Qnil;
     trans->flags = 0;
+    trans->streams = trans->streams_last = NULL;
     rb_obj_call_init(transaction, 0, NULL);
     return transaction;
 }
@@ -485,4 +1323,6 @@ void _init_rb_jio_file()
     rb_define_method(rb_cJioFile, "error?", rb_jio_file_error_p, 0);
     rb_define_method(rb_cJioFile, "clearerr", rb_jio_file_clearerr, 0);
     rb_define_method(rb_cJioFile, "transaction", rb_jio_file_new_transaction, 1);
+    rb_define_method(rb_cJioFile, "follow", rb_jio_file_follow, -1);
+    rb_define_method(rb_cJioFile, "each_chunk", rb_jio_file_each_chunk, -1);
 }
\ No newline at end of file
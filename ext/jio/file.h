@@ -2,17 +2,108 @@
 #define JIO_FILE_H
 
 #define JIO_FILE_CLOSED 0x01
+#define JIO_FILE_DIRECT 0x02
+
+/* O_DIRECT reads go through a small pool of aligned, reusable bounce buffers */
+#define JIO_DIRECT_ALIGN 4096
+#define JIO_DIRECT_BUFSIZ (256 * 1024)
+#define JIO_DIRECT_POOL_SIZE 4
+
+/* File#follow reads committed data in chunks of at most this size */
+#define JIO_FOLLOW_BUFSIZ (64 * 1024)
+
+/* A follower blocked on the shared inotify descriptor, woken through its eventfd by other followers */
+typedef struct jio_follow_waiter {
+    int wake_fd;
+    struct jio_follow_waiter *next;
+} jio_follow_waiter;
+
+/* Followers of the same file share an inotify watch, reference counted and tagged with a generation */
+typedef struct jio_follow_watch {
+    int wd;
+    int refs;
+    unsigned long gen;
+    jio_follow_waiter *waiters;
+    struct jio_follow_watch *next;
+} jio_follow_watch;
 
 typedef struct {
     jfs_t *fs;
+    char *path;
     int flags;
+    int direct_fd;
+    int dirty_fd;
+    void *pool[JIO_DIRECT_POOL_SIZE];
+    int pool_len;
+    unsigned long wgen;
+    struct jio_map_wrapper *maps;
+    int users;
+    pthread_mutex_t lock;
 } jio_jfs_wrapper;
 
+/* Bumped on every write through a handle, invalidating JIO::Reader buffers over it */
+#if defined(__GNUC__)
+#define JioFileWritten(file) __sync_fetch_and_add(&(file)->wgen, 1)
+#else
+#define JioFileWritten(file) (file)->wgen++
+#endif
+
+typedef struct {
+    jio_jfs_wrapper *file;
+    jio_follow_watch *watch;
+    off_t offset;
+    int poll_fd;
+    int waiting;
+    jio_follow_waiter waiter;
+} jio_follow_args;
+
+/* File#each_chunk keeps this many chunks read ahead by default */
+#define JIO_READAHEAD_SLOTS 4
+
+/* Ring of chunk buffers, filled by a native thread and drained by File#each_chunk */
+typedef struct {
+    jfs_t *fs;
+    jio_jfs_wrapper *file;
+    size_t size;
+    int slots;
+    char **bufs;
+    ssize_t *lens;
+    int *errs;
+    int head;
+    int tail;
+    int filled;
+    int stop;
+    off_t offset;
+    int notify[2];
+    int started;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} jio_readahead;
+
+#ifdef RUBY_TYPED_FROZEN_SHAREABLE
+extern const rb_data_type_t jio_file_type;
+#define JioFileStruct(obj, file) TypedData_Get_Struct(obj, jio_jfs_wrapper, &jio_file_type, file)
+#else
+#define JioFileStruct(obj, file) Data_Get_Struct(obj, jio_jfs_wrapper, file)
+#endif
+
+struct jio_multi_op;
+
+ssize_t jio_file_pread(jio_jfs_wrapper *file, void *buf, size_t count, off_t offset);
+void jio_direct_dontneed_ops(jio_jfs_wrapper *file, struct operation *op, struct jio_multi_op *mop, long idx);
+int jio_file_hold(jio_jfs_wrapper *file);
+void jio_file_release(jio_jfs_wrapper *file);
+
+/* Operations on a handle's jfs hold it in use for their duration, see jio_file_hold */
+#define JioHoldFile(file) \
+    if (jio_file_hold(file) != 0) rb_raise(rb_eIOError, "closed JIO::File");
+
 #define JioAssertFile(obj) JioAssertType(obj, rb_cJioFile, "JIO::File")
 #define JioGetFile(obj) \
     jio_jfs_wrapper *file = NULL; \
     JioAssertFile(obj); \
-    Data_Get_Struct(obj, jio_jfs_wrapper, file); \
+    JioFileStruct(obj, file); \
     if (!file) rb_raise(rb_eTypeError, "uninitialized JIO file handle!");
 
 void _init_rb_jio_file();
@@ -0,0 +1,192 @@
+#include "jio_ext.h"
+
+/*
+ *  GC callbacks for JIO::Index
+ */
+static void rb_jio_mark_index(void *ptr)
+{
+    jio_index_wrapper *index = (jio_index_wrapper *)ptr;
+    if (ptr) rb_gc_mark(index->file);
+}
+
+static void rb_jio_free_index(void *ptr)
+{
+    jio_index_wrapper *index = (jio_index_wrapper *)ptr;
+    if (index) {
+        if (index->map != NULL) munmap(index->map, index->len);
+        xfree(index);
+    }
+}
+
+/*
+ *  Entries are appended through (multi file) transactions on the index file, so the read-only mapping
+ *  is refreshed whenever the file size changed.
+ */
+static void jio_index_remap(jio_index_wrapper *index)
+{
+    struct stat st;
+    size_t len;
+    jio_jfs_wrapper *file = NULL;
+    JioFileStruct(index->file, file);
+    JioHoldFile(file);
+    if (fstat(file->fs->fd, &st) != 0) {
+        jio_file_release(file);
+        rb_sys_fail("fstat");
+    }
+    len = (size_t)st.st_size - ((size_t)st.st_size % JIO_INDEX_ENTRY_SIZE);
+    if (len != index->len) {
+        if (index->map != NULL) munmap(index->map, index->len);
+        index->map = NULL;
+        index->len = 0;
+        if (len > 0) index->map = (unsigned char *)mmap(NULL, len, PROT_READ, MAP_SHARED, file->fs->fd, 0);
+    }
+    jio_file_release(file);
+    if (index->map == MAP_FAILED) {
+        index->map = NULL;
+        rb_sys_fail("mmap");
+    }
+    if (index->map != NULL) index->len = len;
+}
+
+static inline uint64_t jio_index_field(jio_index_wrapper *index, size_t i, int field)
+{
+    uint64_t val;
+    memcpy(&val, index->map + i * JIO_INDEX_ENTRY_SIZE + field * sizeof(uint64_t), sizeof(uint64_t));
+    return ntohll(val);
+}
+
+static VALUE jio_index_entry(jio_index_wrapper *index, size_t i)
+{
+    return rb_ary_new3(2, ULL2NUM(jio_index_field(index, i, 0)), OFFT2NUM((off_t)jio_index_field(index, i, 1)));
+}
+
+/*
+ *  call-seq:
+ *     JIO::Index.new(file)    =>  JIO::Index
+ *
+ *  Returns a memory mapped view of a file of sorted (sequence number, offset) entries, as maintained
+ *  by JIO::Log. Lookups never issue read syscalls.
+ *
+ * === Examples
+ *     JIO::Index.new(file)    =>  JIO::Index
+ *
+*/
+
+static VALUE rb_jio_s_index_new(JIO_UNUSED VALUE klass, VALUE file)
+{
+    VALUE obj;
+    jio_index_wrapper *index = NULL;
+    JioAssertFile(file);
+    obj = Data_Make_Struct(rb_cJioIndex, jio_index_wrapper, rb_jio_mark_index, rb_jio_free_index, index);
+    index->file = file;
+    index->map = NULL;
+    index->len = 0;
+    jio_index_remap(index);
+    rb_obj_call_init(obj, 0, NULL);
+    return obj;
+}
+
+/*
+ *  call-seq:
+ *     index.size    =>  Integer
+ *
+ *  Returns the number of entries in the index.
+ *
+ * === Examples
+ *     index.size    =>  Integer
+ *
+*/
+
+static VALUE rb_jio_index_size(VALUE obj)
+{
+    JioGetIndex(obj);
+    jio_index_remap(index);
+    return ULONG2NUM(index->len / JIO_INDEX_ENTRY_SIZE);
+}
+
+/*
+ *  call-seq:
+ *     index[0]    =>  [seq, offset]
+ *
+ *  Returns the entry at a given position, nil if out of range.
+ *
+ * === Examples
+ *     index[0]    =>  [seq, offset]
+ *
+*/
+
+static VALUE rb_jio_index_aref(VALUE obj, VALUE pos)
+{
+    long i;
+    size_t n;
+    JioGetIndex(obj);
+    jio_index_remap(index);
+    n = index->len / JIO_INDEX_ENTRY_SIZE;
+    i = NUM2LONG(pos);
+    if (i < 0) i += (long)n;
+    if (i < 0 || (size_t)i >= n) return Qnil;
+    return jio_index_entry(index, (size_t)i);
+}
+
+/*
+ *  call-seq:
+ *     index.lookup(100)    =>  [seq, offset]
+ *
+ *  Binary searches for the entry with the greatest sequence number lower than or equal to the given
+ *  one. Returns nil if there's no such entry.
+ *
+ * === Examples
+ *     index.lookup(100)    =>  [seq, offset]
+ *
+*/
+
+static VALUE rb_jio_index_lookup(VALUE obj, VALUE seq)
+{
+    uint64_t target;
+    size_t lo, hi, mid;
+    JioGetIndex(obj);
+    target = NUM2ULL(seq);
+    jio_index_remap(index);
+    lo = 0;
+    hi = index->len / JIO_INDEX_ENTRY_SIZE;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (jio_index_field(index, mid, 0) <= target) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == 0) return Qnil;
+    return jio_index_entry(index, lo - 1);
+}
+
+/*
+ *  call-seq:
+ *     index.file    =>  JIO::File
+ *
+ *  Returns the underlying libjio file handle.
+ *
+ * === Examples
+ *     index.file    =>  JIO::File
+ *
+*/
+
+static VALUE rb_jio_index_file(VALUE obj)
+{
+    JioGetIndex(obj);
+    return index->file;
+}
+
+void _init_rb_jio_index()
+{
+    rb_cJioIndex = rb_define_class_under(mJio, "Index", rb_cObject);
+
+    rb_define_const(rb_cJioIndex, "ENTRY_SIZE", INT2NUM(JIO_INDEX_ENTRY_SIZE));
+
+    rb_define_singleton_method(rb_cJioIndex, "new", rb_jio_s_index_new, 1);
+    rb_define_method(rb_cJioIndex, "size", rb_jio_index_size, 0);
+    rb_define_method(rb_cJioIndex, "[]", rb_jio_index_aref, 1);
+    rb_define_method(rb_cJioIndex, "lookup", rb_jio_index_lookup, 1);
+    rb_define_method(rb_cJioIndex, "file", rb_jio_index_file, 0);
+}
@@ -0,0 +1,22 @@
+#ifndef JIO_INDEX_H
+#define JIO_INDEX_H
+
+/* An index entry is a sequence number and a file offset, both 64 bit and in network byte order */
+#define JIO_INDEX_ENTRY_SIZE 16
+
+typedef struct {
+    VALUE file;
+    unsigned char *map;
+    size_t len;
+} jio_index_wrapper;
+
+#define JioAssertIndex(obj) JioAssertType(obj, rb_cJioIndex, "JIO::Index")
+#define JioGetIndex(obj) \
+    jio_index_wrapper *index = NULL; \
+    JioAssertIndex(obj); \
+    Data_Get_Struct(obj, jio_index_wrapper, index); \
+    if (!index) rb_raise(rb_eTypeError, "uninitialized JIO index handle!");
+
+void _init_rb_jio_index();
+
+#endif
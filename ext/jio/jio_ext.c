@@ -3,9 +3,12 @@
 VALUE mJio;
 VALUE rb_cJioFile;
 VALUE rb_cJioTransaction;
+VALUE rb_cJioMultiTransaction;
+VALUE rb_cJioIndex;
+VALUE rb_cJioReader;
+VALUE rb_cJioMap;
 
 VALUE jio_zero;
-VALUE jio_empty_view;
 
 #ifdef HAVE_RUBY_ENCODING_H
 rb_encoding *binary_encoding;
@@ -21,24 +24,43 @@ static VALUE jio_s_reapplied;
 /*
  *  call-seq:
  *     JIO.check("/path/file", JIO::J_CLEANUP)    =>  Hash
+ *     JIO.check("/path/file", JIO::J_CLEANUP, "/path/journal")    =>  Hash
  *
- *  Checks and repairs a file previously created and managed through libjio.
+ *  Checks and repairs a file previously created and managed through libjio. Multi file transaction
+ *  records coordinated by this file are replayed first. Journals moved with File#move_journal need
+ *  their location passed in.
  *
  * === Examples
  *     JIO.check("/path/file", JIO::J_CLEANUP)    =>  Hash
  *
 */
 
-static VALUE rb_jio_s_check(JIO_UNUSED VALUE jio, VALUE path, VALUE flags)
+static VALUE rb_jio_s_check(int argc, VALUE *argv, JIO_UNUSED VALUE jio)
 {
     int ret;
-    VALUE result;
+    VALUE path, flags, jdir, result;
+    const char *jdir_path = NULL;
     struct jfsck_result res;
+    struct jfsck_result multi_res;
+    rb_scan_args(argc, argv, "21", &path, &flags, &jdir);
     Check_Type(path, T_STRING);
     Check_Type(flags, T_FIXNUM);
-    ret = jfsck(RSTRING_PTR(path), NULL, &res, FIX2UINT(flags));
+    if (!NIL_P(jdir)) {
+        Check_Type(jdir, T_STRING);
+        jdir_path = RSTRING_PTR(jdir);
+    }
+    memset(&multi_res, 0, sizeof(struct jfsck_result));
+    TRAP_BEG;
+    ret = jio_multi_recover(RSTRING_PTR(path), jdir_path, &multi_res);
+    TRAP_END;
+    if (ret < 0) rb_sys_fail("jio_multi_recover");
+    ret = jfsck(RSTRING_PTR(path), jdir_path, &res, FIX2UINT(flags));
     if (ret == J_ENOMEM) rb_memerror();
     if (ret < 0) rb_sys_fail("jfsck");
+    res.total += multi_res.total;
+    res.broken += multi_res.broken;
+    res.corrupt += multi_res.corrupt;
+    res.reapplied += multi_res.reapplied;
     result = rb_hash_new();
     rb_hash_aset(result, jio_s_total, INT2NUM(res.total));
     rb_hash_aset(result, jio_s_invalid, INT2NUM(res.invalid));
@@ -49,17 +71,63 @@ static VALUE rb_jio_s_check(JIO_UNUSED VALUE jio, VALUE path, VALUE flags)
     return result;
 }
 
+/*
+ *  call-seq:
+ *     JIO.crc32c("buffer")    =>  Integer
+ *     JIO.crc32c("buffer", crc)    =>  Integer
+ *
+ *  Calculates the CRC32c (RFC 3309) checksum libjio uses for transaction files. An optional previous
+ *  checksum allows for incremental checksumming of consecutive buffers.
+ *
+ * === Examples
+ *     JIO.crc32c("buffer")    =>  Integer
+ *
+*/
+
+static VALUE rb_jio_s_crc32c(int argc, VALUE *argv, JIO_UNUSED VALUE jio)
+{
+    VALUE buf, crc;
+    rb_scan_args(argc, argv, "11", &buf, &crc);
+    Check_Type(buf, T_STRING);
+    return UINT2NUM(checksum_buf(NIL_P(crc) ? 0 : NUM2UINT(crc), (const unsigned char *)RSTRING_PTR(buf), (size_t)RSTRING_LEN(buf)));
+}
+
+#ifdef FIU_ENABLE
+/*
+ *  call-seq:
+ *     JIO.fail_at("jio/commit/tf_sync")    =>  nil
+ *
+ *  Enables a libfiu failure point in libjio's (or the multi file transaction) commit path. Points
+ *  declared with fiu_exit_on terminate the process with EXIT_FAILURE once reached, which is how the
+ *  crash recovery harness simulates a crash at a known step. Only defined when built with
+ *  --enable-fiu.
+ *
+ * === Examples
+ *     JIO.fail_at("jio/commit/tf_sync")    =>  nil
+ *
+*/
+
+static VALUE rb_jio_s_fail_at(JIO_UNUSED VALUE jio, VALUE name)
+{
+    Check_Type(name, T_STRING);
+    if (fiu_enable(RSTRING_PTR(name), 1, NULL, 0) != 0) rb_raise(rb_eArgError, "could not enable failure point %s", RSTRING_PTR(name));
+    return Qnil;
+}
+#endif
+
 void
 Init_jio_ext()
 {
     mJio = rb_define_module("JIO");
 
+#ifdef RB_EXT_RACTOR_SAFE
+    RB_EXT_RACTOR_SAFE(true);
+#endif
+
 /*
- *  Generic globals (Fixnum 0 and empty Array for blank transaction views)
+ *  Generic globals (Fixnum 0). Symbols and classes are shareable between Ractors.
  */
     jio_zero = INT2NUM(0);
-    rb_gc_register_address(&jio_empty_view);
-    jio_empty_view = rb_ary_new();
 
     jio_s_total = ID2SYM(rb_intern("total"));
     jio_s_invalid = ID2SYM(rb_intern("invalid"));
@@ -101,6 +169,9 @@ Init_jio_ext()
     rb_define_const(mJio, "NDELAY", INT2NUM(O_NDELAY));
     rb_define_const(mJio, "SYNC", INT2NUM(O_SYNC));
     rb_define_const(mJio, "ASYNC", INT2NUM(O_ASYNC));
+#ifdef O_DIRECT
+    rb_define_const(mJio, "DIRECT", INT2NUM(O_DIRECT));
+#endif
 
 /*
  *  lseek specific constants
@@ -112,8 +183,18 @@ Init_jio_ext()
 /*
  *  JIO module methods
  */
-    rb_define_module_function(mJio, "check", rb_jio_s_check, 2);
+    rb_define_module_function(mJio, "check", rb_jio_s_check, -1);
+    rb_define_module_function(mJio, "crc32c", rb_jio_s_crc32c, -1);
+#ifdef FIU_ENABLE
+    fiu_init(0);
+    rb_define_module_function(mJio, "fail_at", rb_jio_s_fail_at, 1);
+#endif
 
     _init_rb_jio_file();
     _init_rb_jio_transaction();
+    _init_rb_jio_multi();
+    _init_rb_jio_index();
+    _init_rb_jio_reader();
+    _init_rb_jio_map();
+    _init_rb_jio_snapshot();
 }
\ No newline at end of file
@@ -3,11 +3,32 @@
 
 #include "libjio.h"
 #include "trans.h"
+#include "common.h"
 #include "ruby.h"
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <dirent.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+#ifdef FIU_ENABLE
+#include <fiu-control.h>
+#endif
+#ifdef HAVE_LINUX_FS_H
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
 
 /* Compiler specific */
 
@@ -35,12 +56,20 @@
 
 #include "file.h"
 #include "transaction.h"
+#include "multi.h"
+#include "index.h"
+#include "reader.h"
+#include "map.h"
+#include "snapshot.h"
 
 extern VALUE mJio;
 extern VALUE rb_cJioFile;
 extern VALUE rb_cJioTransaction;
+extern VALUE rb_cJioMultiTransaction;
+extern VALUE rb_cJioIndex;
+extern VALUE rb_cJioReader;
+extern VALUE rb_cJioMap;
 
 extern VALUE jio_zero;
-extern VALUE jio_empty_view;
 
 #endif
\ No newline at end of file
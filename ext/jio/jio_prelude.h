@@ -19,4 +19,24 @@
 #endif
 #endif
 
+/*
+ * Runs a blocking libjio call (commits, syncs) with the GVL released where the interpreter has one,
+ * so threads working on other files or shards aren't held up by a single fsync. The call can't be
+ * interrupted half way, so no unblocking function is given, and func must not touch any Ruby API.
+ */
+#if defined(RUBINIUS) || defined(JRUBY)
+static inline void *jio_blocking_call(void *(*func)(void *), void *data)
+{
+    return func(data);
+}
+#elif defined(HAVE_RB_THREAD_CALL_WITHOUT_GVL)
+#include <ruby/thread.h>
+#define jio_blocking_call(func, data) rb_thread_call_without_gvl((func), (data), NULL, NULL)
+#else
+static inline void *jio_blocking_call(void *(*func)(void *), void *data)
+{
+    return (void *)rb_thread_blocking_region((rb_blocking_function_t *)func, data, NULL, NULL);
+}
+#endif
+
 #endif
\ No newline at end of file
@@ -0,0 +1,412 @@
+#include "jio_ext.h"
+
+/*
+ *  Read locks held by a process on a file aren't reference counted - unlocking a range releases it
+ *  entirely, even where live maps of the same handle overlap it. Only the parts of the range that no
+ *  map other than skip covers are unlocked. An end of -1 stands for the end of the file. Called with
+ *  the handle's lock held.
+ */
+void jio_map_unlock_range(jio_jfs_wrapper *fw, jio_map_wrapper *skip, off_t cur, off_t end)
+{
+    jio_map_wrapper *m;
+    off_t next;
+    int covered;
+    while (end < 0 || cur < end) {
+        do {
+            covered = 0;
+            for (m = fw->maps; m != NULL; m = m->next) {
+                if (m != skip && m->offset <= cur && cur < m->offset + (off_t)m->len) {
+                    cur = m->offset + (off_t)m->len;
+                    covered = 1;
+                }
+            }
+        } while (covered && (end < 0 || cur < end));
+        if (end >= 0 && cur >= end) break;
+        next = end;
+        for (m = fw->maps; m != NULL; m = m->next) {
+            if (m != skip && m->offset > cur && (next < 0 || m->offset < next)) next = m->offset;
+        }
+        plockf(fw->fs->fd, F_UNLOCK, cur, next < 0 ? 0 : next - cur);
+        if (next < 0) break;
+        cur = next;
+    }
+}
+
+static void jio_map_unmap(jio_map_wrapper *map)
+{
+    jio_map_wrapper **prev;
+    jio_jfs_wrapper *fw = map->fw;
+    if (map->unmapped) return;
+    if (fw != NULL) {
+        pthread_mutex_lock(&fw->lock);
+        if (map->fw != NULL) {
+            if (map->len > 0) jio_map_unlock_range(fw, map, map->offset, map->offset + (off_t)map->len);
+            for (prev = &fw->maps; *prev != map; prev = &(*prev)->next);
+            *prev = map->next;
+            map->fw = NULL;
+        }
+        pthread_mutex_unlock(&fw->lock);
+    }
+    if (map->addr != NULL) munmap(map->addr, map->maplen);
+    map->addr = NULL;
+    map->unmapped = 1;
+}
+
+/*
+ *  libjio releases the locks it took for a read, write or commit over the whole range once done,
+ *  including parts this process held read locks on for its maps. Re-takes the read locks of all live
+ *  maps of a handle afterwards. Maps whose lock can't be re-taken no longer keep writers out, so
+ *  they're unmapped. Returns the errno of the first failure, 0 if none.
+ */
+int jio_map_relock(jio_jfs_wrapper *file)
+{
+    jio_map_wrapper *m, **prev;
+    int err = 0;
+    pthread_mutex_lock(&file->lock);
+    for (prev = &file->maps; (m = *prev) != NULL;) {
+        if (m->len == 0 || plockf(file->fs->fd, F_LOCKR, m->offset, (off_t)m->len) == 0) {
+            prev = &m->next;
+            continue;
+        }
+        if (err == 0) err = errno;
+        *prev = m->next;
+        m->fw = NULL;
+        jio_map_unlock_range(file, NULL, m->offset, m->offset + (off_t)m->len);
+        munmap(m->addr, m->maplen);
+        m->addr = NULL;
+        m->unmapped = 1;
+    }
+    pthread_mutex_unlock(&file->lock);
+    return err;
+}
+
+/*
+ *  Raises the error returned by jio_map_relock, once the caller no longer holds the handle
+ */
+void jio_map_check_relock(int err)
+{
+    if (err == 0) return;
+    errno = err;
+    rb_sys_fail("plockf (maps unmapped)");
+}
+
+/*
+ *  Closing or freeing a file handle drops all of its locks. Maps stay readable, but no longer
+ *  reference the handle's wrapper.
+ */
+void jio_map_detach_all(jio_jfs_wrapper *file)
+{
+    jio_map_wrapper *map, *next;
+    pthread_mutex_lock(&file->lock);
+    for (map = file->maps; map != NULL; map = next) {
+        next = map->next;
+        map->fw = NULL;
+        map->next = NULL;
+    }
+    file->maps = NULL;
+    pthread_mutex_unlock(&file->lock);
+}
+
+/*
+ *  GC callbacks for JIO::Map
+ */
+static void rb_jio_mark_map(void *ptr)
+{
+    jio_map_wrapper *map = (jio_map_wrapper *)ptr;
+    if (ptr) rb_gc_mark(map->file);
+}
+
+static void rb_jio_free_map(void *ptr)
+{
+    jio_map_wrapper *map = (jio_map_wrapper *)ptr;
+    if (map) {
+        jio_map_unmap(map);
+        xfree(map);
+    }
+}
+
+static VALUE jio_map_ensure_unmap(VALUE obj)
+{
+    JioGetMap(obj);
+    jio_map_unmap(map);
+    return Qnil;
+}
+
+/*
+ *  call-seq:
+ *     file.map(0, 4096)    =>  JIO::Map
+ *
+ *  Maps a range of the file read-only and shared, holding a read lock on it until unmapped. As
+ *  transactions take write locks on the ranges they apply to, commits from other processes to the
+ *  range wait for the map to go away. Maps are unmapped explicitly, when garbage collected or, if a
+ *  block is given, once it returns. The range must be within the file.
+ *
+ *  fcntl locks belong to the process, not the map. Reads through the handle leave the maps' locks in
+ *  place, but writes and commits from this process release them over the ranges they apply to, and
+ *  they're only re-taken once done - a commit from another process queued on the range may apply in
+ *  between. Maps only see consistent data while this process doesn't write to the mapped range.
+ *
+ * === Examples
+ *     file.map(0, 4096)    =>  JIO::Map
+ *     file.map(0, 4096){|map| map[100, 8] }    =>  String
+ *
+*/
+
+static VALUE rb_jio_file_map(VALUE obj, VALUE offset, VALUE length)
+{
+    VALUE res;
+    struct stat st;
+    off_t off, base;
+    size_t len;
+    long pagesz;
+    int err, ret;
+    jio_map_wrapper *map = NULL;
+    JioGetFile(obj);
+    AssertOffset(offset);
+    AssertLength(length);
+    off = (off_t)NUM2OFFT(offset);
+    len = (size_t)FIX2LONG(length);
+    /* allocated upfront, so nothing raises while the handle is held */
+    res = Data_Make_Struct(rb_cJioMap, jio_map_wrapper, rb_jio_mark_map, rb_jio_free_map, map);
+    map->file = obj;
+    map->fw = NULL;
+    map->addr = NULL;
+    map->offset = off;
+    map->len = len;
+    map->maplen = 0;
+    map->unmapped = 1;
+    map->next = NULL;
+    JioHoldFile(file);
+    if (len > 0) {
+        TRAP_BEG;
+        ret = plockf(file->fs->fd, F_LOCKR, off, (off_t)len);
+        TRAP_END;
+        if (ret != 0) {
+            err = errno;
+            jio_file_release(file);
+            errno = err;
+            rb_sys_fail("plockf");
+        }
+    }
+    if (fstat(file->fs->fd, &st) != 0) {
+        err = errno;
+        if (len > 0) plockf(file->fs->fd, F_UNLOCK, off, (off_t)len);
+        jio_file_release(file);
+        errno = err;
+        rb_sys_fail("fstat");
+    }
+    if (off + (off_t)len > st.st_size) {
+        if (len > 0) plockf(file->fs->fd, F_UNLOCK, off, (off_t)len);
+        jio_file_release(file);
+        rb_raise(rb_eArgError, "range past end of file");
+    }
+    if (len > 0) {
+        pagesz = sysconf(_SC_PAGESIZE);
+        base = off & ~((off_t)pagesz - 1);
+        map->maplen = len + (size_t)(off - base);
+        map->addr = (char *)mmap(NULL, map->maplen, PROT_READ, MAP_SHARED, file->fs->fd, base);
+        if (map->addr == MAP_FAILED) {
+            err = errno;
+            map->addr = NULL;
+            plockf(file->fs->fd, F_UNLOCK, off, (off_t)len);
+            jio_file_release(file);
+            errno = err;
+            rb_sys_fail("mmap");
+        }
+    }
+    map->unmapped = 0;
+    pthread_mutex_lock(&file->lock);
+    map->fw = file;
+    map->next = file->maps;
+    file->maps = map;
+    pthread_mutex_unlock(&file->lock);
+    jio_file_release(file);
+    rb_obj_call_init(res, 0, NULL);
+    if (rb_block_given_p()) return rb_ensure(rb_yield, res, jio_map_ensure_unmap, res);
+    return res;
+}
+
+/*
+ *  call-seq:
+ *     map[0, 8]    =>  String or nil
+ *
+ *  Returns a copy of the given number of bytes at a position relative to the start of the map, or a
+ *  single byte if no length is given. Doesn't issue any system calls. Returns nil if the position is
+ *  out of range, and shorter strings at the end of the map.
+ *
+ * === Examples
+ *     map[0, 8]    =>  String or nil
+ *     map[-1]    =>  String or nil
+ *
+*/
+
+static VALUE rb_jio_map_aref(int argc, VALUE *argv, VALUE obj)
+{
+    VALUE pos, length;
+    long i, n;
+    JioGetMap(obj);
+    JioAssertMapped(map);
+    n = 1;
+    if (rb_scan_args(argc, argv, "11", &pos, &length) == 2) {
+        n = NUM2LONG(length);
+        if (n < 0) return Qnil;
+    }
+    i = NUM2LONG(pos);
+    if (i < 0) i += (long)map->len;
+    if (i < 0 || i > (long)map->len || (argc == 1 && i == (long)map->len)) return Qnil;
+    if (n > (long)map->len - i) n = (long)map->len - i;
+    return JioEncode(rb_str_new(JioMapPtr(map) + i, n));
+}
+
+/*
+ *  call-seq:
+ *     map.getbyte(0)    =>  Fixnum or nil
+ *
+ *  Returns the byte at a given position, nil if out of range.
+ *
+ * === Examples
+ *     map.getbyte(0)    =>  Fixnum or nil
+ *
+*/
+
+static VALUE rb_jio_map_getbyte(VALUE obj, VALUE pos)
+{
+    long i;
+    JioGetMap(obj);
+    JioAssertMapped(map);
+    i = NUM2LONG(pos);
+    if (i < 0) i += (long)map->len;
+    if (i < 0 || i >= (long)map->len) return Qnil;
+    return INT2FIX((unsigned char)JioMapPtr(map)[i]);
+}
+
+/*
+ *  call-seq:
+ *     map.index("key")    =>  Fixnum or nil
+ *
+ *  Returns the position of the first occurrence of a string at or after a given position.
+ *
+ * === Examples
+ *     map.index("key")    =>  Fixnum or nil
+ *     map.index("key", 100)    =>  Fixnum or nil
+ *
+*/
+
+static VALUE rb_jio_map_index(int argc, VALUE *argv, VALUE obj)
+{
+    VALUE str, pos;
+    long i = 0;
+    const char *hit;
+    JioGetMap(obj);
+    JioAssertMapped(map);
+    rb_scan_args(argc, argv, "11", &str, &pos);
+    Check_Type(str, T_STRING);
+    if (!NIL_P(pos)) i = NUM2LONG(pos);
+    if (i < 0) i += (long)map->len;
+    if (i < 0 || i > (long)map->len) return Qnil;
+    hit = memmem(JioMapPtr(map) + i, map->len - (size_t)i, RSTRING_PTR(str), (size_t)RSTRING_LEN(str));
+    return hit == NULL ? Qnil : LONG2NUM((long)(hit - JioMapPtr(map)));
+}
+
+/*
+ *  call-seq:
+ *     map.to_s    =>  String
+ *
+ *  Returns a copy of the mapped range.
+ *
+ * === Examples
+ *     map.to_s    =>  String
+ *
+*/
+
+static VALUE rb_jio_map_to_s(VALUE obj)
+{
+    JioGetMap(obj);
+    JioAssertMapped(map);
+    return JioEncode(rb_str_new(JioMapPtr(map), (long)map->len));
+}
+
+/*
+ *  call-seq:
+ *     map.size    =>  Fixnum
+ *
+ *  Returns the length of the mapped range.
+ *
+ * === Examples
+ *     map.size    =>  Fixnum
+ *
+*/
+
+static VALUE rb_jio_map_size(VALUE obj)
+{
+    JioGetMap(obj);
+    return ULONG2NUM(map->len);
+}
+
+/*
+ *  call-seq:
+ *     map.offset    =>  Fixnum
+ *
+ *  Returns the file offset the map starts at.
+ *
+ * === Examples
+ *     map.offset    =>  Fixnum
+ *
+*/
+
+static VALUE rb_jio_map_offset(VALUE obj)
+{
+    JioGetMap(obj);
+    return OFFT2NUM(map->offset);
+}
+
+/*
+ *  call-seq:
+ *     map.unmap    =>  nil
+ *
+ *  Unmaps the range and releases its read lock.
+ *
+ * === Examples
+ *     map.unmap    =>  nil
+ *
+*/
+
+static VALUE rb_jio_map_unmap(VALUE obj)
+{
+    JioGetMap(obj);
+    jio_map_unmap(map);
+    return Qnil;
+}
+
+/*
+ *  call-seq:
+ *     map.mapped?    =>  boolean
+ *
+ *  Determines if the range is still mapped.
+ *
+ * === Examples
+ *     map.mapped?    =>  boolean
+ *
+*/
+
+static VALUE rb_jio_map_mapped_p(VALUE obj)
+{
+    JioGetMap(obj);
+    return map->unmapped ? Qfalse : Qtrue;
+}
+
+void _init_rb_jio_map()
+{
+    rb_define_method(rb_cJioFile, "map", rb_jio_file_map, 2);
+
+    rb_cJioMap = rb_define_class_under(mJio, "Map", rb_cObject);
+
+    rb_define_method(rb_cJioMap, "[]", rb_jio_map_aref, -1);
+    rb_define_method(rb_cJioMap, "getbyte", rb_jio_map_getbyte, 1);
+    rb_define_method(rb_cJioMap, "index", rb_jio_map_index, -1);
+    rb_define_method(rb_cJioMap, "to_s", rb_jio_map_to_s, 0);
+    rb_define_method(rb_cJioMap, "size", rb_jio_map_size, 0);
+    rb_define_method(rb_cJioMap, "offset", rb_jio_map_offset, 0);
+    rb_define_method(rb_cJioMap, "unmap", rb_jio_map_unmap, 0);
+    rb_define_method(rb_cJioMap, "mapped?", rb_jio_map_mapped_p, 0);
+}
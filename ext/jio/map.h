@@ -0,0 +1,35 @@
+#ifndef JIO_MAP_H
+#define JIO_MAP_H
+
+typedef struct jio_map_wrapper {
+    VALUE file;
+    jio_jfs_wrapper *fw;
+    char *addr;
+    size_t maplen;
+    off_t offset;
+    size_t len;
+    int unmapped;
+    struct jio_map_wrapper *next;
+} jio_map_wrapper;
+
+#define JioAssertMap(obj) JioAssertType(obj, rb_cJioMap, "JIO::Map")
+#define JioGetMap(obj) \
+    jio_map_wrapper *map = NULL; \
+    JioAssertMap(obj); \
+    Data_Get_Struct(obj, jio_map_wrapper, map); \
+    if (!map) rb_raise(rb_eTypeError, "uninitialized JIO map handle!");
+
+#define JioAssertMapped(map) \
+    if (map->unmapped) rb_raise(rb_eIOError, "unmapped JIO::Map");
+
+/* Pointer to the first byte of the view, which needn't be page aligned */
+#define JioMapPtr(map) (map->addr + (map->maplen - map->len))
+
+void jio_map_unlock_range(jio_jfs_wrapper *fw, jio_map_wrapper *skip, off_t cur, off_t end);
+int jio_map_relock(jio_jfs_wrapper *file);
+void jio_map_check_relock(int err);
+void jio_map_detach_all(jio_jfs_wrapper *file);
+
+void _init_rb_jio_map();
+
+#endif
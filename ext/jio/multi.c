@@ -0,0 +1,719 @@
+#include "jio_ext.h"
+
+/*
+ *  Multi file transaction records
+ *
+ *  A multi file transaction is journaled as a single record in the journal directory of the first
+ *  (coordinator) file, instead of one libjio transaction file per participant. The record lists the
+ *  real paths of all participating files, followed by every write operation and a trailer with the
+ *  operation count and a checksum of everything preceding it :
+ *
+ *    "JIOM" | nfiles | (namelen | name) * nfiles | (idx | len | offset | data) * numops | numops | csum
+ *
+ *  All integers are stored in network byte order, as libjio does for its own transaction files. The
+ *  record is synced once, then applied to each file and removed. JIO.check on the coordinator replays
+ *  any complete record left behind by a crash before running jfsck.
+ */
+
+static int jio_multi_append(int fd, const void *buf, size_t len, off_t *pos, uint32_t *csum)
+{
+    if (spwrite(fd, buf, len, *pos) != (ssize_t)len) return -1;
+    *csum = checksum_buf(*csum, (const unsigned char *)buf, len);
+    *pos += len;
+    return 0;
+}
+
+static int jio_multi_append_u32(int fd, uint32_t val, off_t *pos, uint32_t *csum)
+{
+    val = htonl(val);
+    return jio_multi_append(fd, &val, sizeof(val), pos, csum);
+}
+
+static int jio_multi_append_u64(int fd, uint64_t val, off_t *pos, uint32_t *csum)
+{
+    val = htonll(val);
+    return jio_multi_append(fd, &val, sizeof(val), pos, csum);
+}
+
+/*
+ *  Range locks are always acquired in the same global order (device, inode, offset) to avoid deadlocks
+ *  between concurrent multi file transactions touching the same files.
+ */
+typedef struct {
+    jio_multi_op *op;
+    jfs_t *fs;
+    dev_t dev;
+    ino_t ino;
+} jio_multi_lock;
+
+static int jio_multi_lock_cmp(const void *a, const void *b)
+{
+    const jio_multi_lock *la = (const jio_multi_lock *)a;
+    const jio_multi_lock *lb = (const jio_multi_lock *)b;
+    if (la->dev != lb->dev) return (la->dev < lb->dev) ? -1 : 1;
+    if (la->ino != lb->ino) return (la->ino < lb->ino) ? -1 : 1;
+    if (la->op->offset != lb->op->offset) return (la->op->offset < lb->op->offset) ? -1 : 1;
+    return 0;
+}
+
+static void jio_multi_unlock(jio_multi_lock *locks, unsigned int nlocks)
+{
+    unsigned int i;
+    for (i = 0; i < nlocks; i++) {
+        if (locks[i].fs->flags & J_NOLOCK) continue;
+        plockf(locks[i].fs->fd, F_UNLOCK, locks[i].op->offset, locks[i].op->len);
+    }
+}
+
+/*
+ *  Appends an operation to the record. Streamed operations are read from their source in fixed size
+ *  chunks, checksumming as we go, so the payload never exists in memory as a whole.
+ */
+static int jio_multi_record_op(int rfd, jio_multi_op *op, char *chunk, off_t *pos, uint32_t *csum)
+{
+    ssize_t rv;
+    size_t done, want;
+    if (jio_multi_append_u32(rfd, op->idx, pos, csum) != 0) return -1;
+    if (jio_multi_append_u64(rfd, (uint64_t)op->len, pos, csum) != 0) return -1;
+    if (jio_multi_append_u64(rfd, (uint64_t)op->offset, pos, csum) != 0) return -1;
+    op->rec_offset = *pos;
+    if (op->buf != NULL) return jio_multi_append(rfd, op->buf, op->len, pos, csum);
+    for (done = 0; done < op->len; done += rv) {
+        want = op->len - done;
+        if (want > JIO_STREAM_BUFSIZ) want = JIO_STREAM_BUFSIZ;
+        rv = pread(op->src_fd, chunk, want, op->src_offset + done);
+        if (rv == 0) errno = EIO;
+        if (rv <= 0) return -1;
+        if (jio_multi_append(rfd, chunk, (size_t)rv, pos, csum) != 0) return -1;
+    }
+    return 0;
+}
+
+/*
+ *  Applies an operation to its file. Streamed operations are copied from the synced record, in kernel
+ *  space with copy_file_range(2) where supported.
+ */
+static int jio_multi_apply_op(int rfd, jfs_t *fs, jio_multi_op *op, char *chunk)
+{
+    ssize_t rv;
+    size_t done = 0, want;
+    if (op->buf != NULL) return (spwrite(fs->fd, op->buf, op->len, op->offset) == (ssize_t)op->len) ? 0 : -1;
+#ifdef HAVE_COPY_FILE_RANGE
+    {
+        loff_t roff = op->rec_offset, doff = op->offset;
+        while (done < op->len) {
+            rv = copy_file_range(rfd, &roff, fs->fd, &doff, op->len - done, 0);
+            if (rv <= 0) break;
+            done += rv;
+        }
+        if (done == op->len) return 0;
+    }
+#endif
+    for (; done < op->len; done += rv) {
+        want = op->len - done;
+        if (want > JIO_STREAM_BUFSIZ) want = JIO_STREAM_BUFSIZ;
+        rv = spread(rfd, chunk, want, op->rec_offset + done);
+        if (rv != (ssize_t)want) return -1;
+        if (spwrite(fs->fd, chunk, want, op->offset + done) != (ssize_t)want) return -1;
+    }
+    return 0;
+}
+
+/*
+ *  Commit all operations of a multi file transaction, recording the files by the absolute paths given.
+ *  Returns 1 on success, -1 if nothing was applied and -2 if the record was synced but applying or
+ *  removing it failed, in which case the record may be left in place for JIO.check to replay.
+ */
+int jio_multi_commit(jio_jmulti_wrapper *multi, jfs_t **fss, char **paths, long nfiles)
+{
+    int rfd = -1, ret = -1;
+    unsigned int i, nlocked = 0;
+    long f;
+    off_t pos = 0;
+    uint32_t csum = 0;
+    struct stat st;
+    char record[PATH_MAX];
+    char *chunk = NULL;
+    jio_multi_lock *locks = NULL;
+    jio_multi_op *op;
+
+    locks = malloc(sizeof(jio_multi_lock) * multi->numops);
+    if (locks == NULL) return -1;
+    for (i = 0, op = multi->ops; op != NULL; op = op->next, i++) {
+        if (fstat(fss[op->idx]->fd, &st) != 0) goto exit;
+        if (op->buf == NULL && chunk == NULL) {
+            chunk = malloc(JIO_STREAM_BUFSIZ);
+            if (chunk == NULL) goto exit;
+        }
+        locks[i].op = op;
+        locks[i].fs = fss[op->idx];
+        locks[i].dev = st.st_dev;
+        locks[i].ino = st.st_ino;
+    }
+    qsort(locks, multi->numops, sizeof(jio_multi_lock), jio_multi_lock_cmp);
+    for (nlocked = 0; nlocked < multi->numops; nlocked++) {
+        if (locks[nlocked].fs->flags & J_NOLOCK) continue;
+        if (plockf(locks[nlocked].fs->fd, F_LOCKW, locks[nlocked].op->offset, locks[nlocked].op->len) == -1) goto exit;
+    }
+
+    /* Lingering transactions must hit the disk first, or a later jfsck would replay them over us */
+    for (f = 0; f < nfiles; f++) {
+        if (fss[f]->ltrans != NULL && jsync(fss[f]) != 0) goto exit;
+    }
+
+    snprintf(record, PATH_MAX, "%s/" JIO_MULTI_PREFIX "XXXXXX", fss[0]->jdir);
+    rfd = mkstemp(record);
+    if (rfd < 0) goto exit;
+
+    if (jio_multi_append(rfd, JIO_MULTI_MAGIC, 4, &pos, &csum) != 0) goto unlink_exit;
+    if (jio_multi_append_u32(rfd, (uint32_t)nfiles, &pos, &csum) != 0) goto unlink_exit;
+    for (f = 0; f < nfiles; f++) {
+        if (jio_multi_append_u32(rfd, (uint32_t)strlen(paths[f]), &pos, &csum) != 0) goto unlink_exit;
+        if (jio_multi_append(rfd, paths[f], strlen(paths[f]), &pos, &csum) != 0) goto unlink_exit;
+    }
+    for (op = multi->ops; op != NULL; op = op->next) {
+        if (jio_multi_record_op(rfd, op, chunk, &pos, &csum) != 0) goto unlink_exit;
+    }
+    if (jio_multi_append_u32(rfd, multi->numops, &pos, &csum) != 0) goto unlink_exit;
+    if (jio_multi_append_u32(rfd, csum, &pos, &csum) != 0) goto unlink_exit;
+
+    fiu_exit_on("jio/multi/pre_sync");
+
+    /* The single barrier: once the record and its directory entry are on disk, the transaction is
+       durable for all participating files */
+    if (fsync(rfd) != 0) goto unlink_exit;
+    if (fsync(fss[0]->jdirfd) != 0) goto unlink_exit;
+
+    fiu_exit_on("jio/multi/synced");
+
+    ret = -2;
+    for (op = multi->ops; op != NULL; op = op->next) {
+        if (jio_multi_apply_op(rfd, fss[op->idx], op, chunk) != 0) goto exit;
+        fiu_exit_on("jio/multi/wrote_op");
+    }
+    for (f = 0; f < nfiles; f++) {
+        if (fdatasync(fss[f]->fd) != 0) goto exit;
+    }
+
+    fiu_exit_on("jio/multi/pre_unlink");
+
+    /* As with libjio's own journal_free, the removal must be on disk too - a record coming back after
+       a crash would be replayed over whatever was committed to these files since */
+    if (unlink(record) != 0) goto exit;
+    if (fsync(fss[0]->jdirfd) != 0) goto exit;
+    ret = 1;
+    goto exit;
+
+unlink_exit:
+    unlink(record);
+
+exit:
+    if (rfd >= 0) close(rfd);
+    jio_multi_unlock(locks, nlocked);
+    free(locks);
+    free(chunk);
+    return ret;
+}
+
+/*
+ *  Builds a streamed write operation of length bytes from a source path (read from its start) or an IO
+ *  (read from its current position, which is left untouched). The source is held open until the
+ *  operation is freed.
+ */
+jio_multi_op *jio_multi_stream_op(VALUE source, VALUE offset, VALUE length)
+{
+    int fd, src_fd = -1;
+    off_t dst_offset, src_offset = 0;
+    jio_multi_op *op = NULL;
+    AssertOffset(offset);
+    AssertLength(length);
+    if (FIX2LONG(length) == 0) rb_raise(rb_eArgError, "empty write operation");
+    dst_offset = (off_t)NUM2OFFT(offset);
+    if (TYPE(source) != T_STRING) {
+        src_offset = NUM2OFFT(rb_funcall(source, rb_intern("pos"), 0));
+        src_fd = NUM2INT(rb_funcall(source, rb_intern("fileno"), 0));
+    }
+    /* allocated before the source is opened, so nothing can raise while the descriptor is unowned */
+    op = ALLOC(jio_multi_op);
+    fd = src_fd < 0 ? open(RSTRING_PTR(source), O_RDONLY) : dup(src_fd);
+    if (fd < 0) {
+        xfree(op);
+        rb_sys_fail(src_fd < 0 ? RSTRING_PTR(source) : "dup");
+    }
+    posix_fadvise(fd, src_offset, (off_t)FIX2LONG(length), POSIX_FADV_SEQUENTIAL);
+    op->idx = 0;
+    op->offset = dst_offset;
+    op->len = (size_t)FIX2LONG(length);
+    op->buf = NULL;
+    op->src_fd = fd;
+    op->src_offset = src_offset;
+    op->rec_offset = 0;
+    op->seq = 0;
+    op->next = NULL;
+    return op;
+}
+
+void jio_multi_free_op(jio_multi_op *op)
+{
+    if (op->src_fd >= 0) close(op->src_fd);
+    if (op->buf != NULL) xfree(op->buf);
+    xfree(op);
+}
+
+/*
+ *  Record recovery, used by JIO.check
+ */
+static int jio_multi_read_u32(const unsigned char *map, off_t len, off_t *pos, uint32_t *val)
+{
+    if (*pos + (off_t)sizeof(uint32_t) > len) return -1;
+    memcpy(val, map + *pos, sizeof(uint32_t));
+    *val = ntohl(*val);
+    *pos += sizeof(uint32_t);
+    return 0;
+}
+
+static int jio_multi_read_u64(const unsigned char *map, off_t len, off_t *pos, uint64_t *val)
+{
+    if (*pos + (off_t)sizeof(uint64_t) > len) return -1;
+    memcpy(val, map + *pos, sizeof(uint64_t));
+    *val = ntohll(*val);
+    *pos += sizeof(uint64_t);
+    return 0;
+}
+
+/*
+ *  Replays a single record. Returns 1 if reapplied, 0 if broken (incomplete, or naming a missing file),
+ *  -1 if corrupt (checksum mismatch) and -2 on I/O errors.
+ */
+static int jio_multi_replay(const unsigned char *map, off_t len)
+{
+    int ret = -2;
+    uint32_t nfiles, namelen, numops, csum, idx, i;
+    uint64_t oplen, offset;
+    off_t pos = 4, data;
+    int *fds = NULL;
+    char path[PATH_MAX];
+
+    if (len < 4 || memcmp(map, JIO_MULTI_MAGIC, 4) != 0) return 0;
+    if (len < 4 + 2 * (off_t)sizeof(uint32_t)) return 0;
+    pos = len - 2 * sizeof(uint32_t);
+    jio_multi_read_u32(map, len, &pos, &numops);
+    jio_multi_read_u32(map, len, &pos, &csum);
+    if (checksum_buf(0, map, len - sizeof(uint32_t)) != csum) return -1;
+
+    pos = 4;
+    if (jio_multi_read_u32(map, len, &pos, &nfiles) != 0) return 0;
+    fds = malloc(sizeof(int) * nfiles);
+    if (fds == NULL) return -2;
+    for (i = 0; i < nfiles; i++) fds[i] = -1;
+    for (i = 0; i < nfiles; i++) {
+        if (jio_multi_read_u32(map, len, &pos, &namelen) != 0 || namelen >= PATH_MAX || pos + namelen > len) {
+            ret = 0;
+            goto exit;
+        }
+        memcpy(path, map + pos, namelen);
+        path[namelen] = '\0';
+        pos += namelen;
+        fds[i] = open(path, O_RDWR);
+        if (fds[i] < 0) {
+            /* nothing was written yet - a record naming a file that's gone is reported as broken */
+            if (errno == ENOENT || errno == ENOTDIR) ret = 0;
+            goto exit;
+        }
+    }
+    for (i = 0; i < numops; i++) {
+        if (jio_multi_read_u32(map, len, &pos, &idx) != 0 || idx >= nfiles ||
+            jio_multi_read_u64(map, len, &pos, &oplen) != 0 ||
+            jio_multi_read_u64(map, len, &pos, &offset) != 0 || pos + (off_t)oplen > len) {
+            ret = 0;
+            goto exit;
+        }
+        data = pos;
+        pos += oplen;
+        if (spwrite(fds[idx], map + data, (size_t)oplen, (off_t)offset) != (ssize_t)oplen) goto exit;
+    }
+    for (i = 0; i < nfiles; i++) {
+        if (fdatasync(fds[i]) != 0) goto exit;
+    }
+    ret = 1;
+
+exit:
+    for (i = 0; i < nfiles; i++) {
+        if (fds[i] >= 0) close(fds[i]);
+    }
+    free(fds);
+    return ret;
+}
+
+/*
+ *  Replays complete multi file transaction records found in the journal directory of the given file and
+ *  removes them. Counters are added to the given jfsck result. Returns 0 on success, < 0 on I/O errors.
+ */
+int jio_multi_recover(const char *name, const char *jdir_path, struct jfsck_result *res)
+{
+    int fd, rv, ret = 0;
+    char jdir[PATH_MAX], record[PATH_MAX];
+    DIR *dir;
+    struct dirent *dent;
+    struct stat st;
+    unsigned char *map;
+
+    if (jdir_path != NULL) {
+        if (strlen(jdir_path) >= PATH_MAX) return -1;
+        strcpy(jdir, jdir_path);
+    } else if (!get_jdir(name, jdir)) {
+        return -1;
+    }
+    dir = opendir(jdir);
+    if (dir == NULL) return (errno == ENOENT) ? 0 : -1;
+    while ((dent = readdir(dir)) != NULL) {
+        if (strncmp(dent->d_name, JIO_MULTI_PREFIX, strlen(JIO_MULTI_PREFIX)) != 0) continue;
+        snprintf(record, PATH_MAX, "%s/%s", jdir, dent->d_name);
+        fd = open(record, O_RDONLY);
+        if (fd < 0 || fstat(fd, &st) != 0) {
+            ret = -1;
+            break;
+        }
+        rv = 0;
+        if (st.st_size > 0) {
+            map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            if (map == MAP_FAILED) {
+                close(fd);
+                ret = -1;
+                break;
+            }
+            rv = jio_multi_replay(map, st.st_size);
+            munmap(map, st.st_size);
+        }
+        close(fd);
+        if (rv == -2) {
+            ret = -1;
+            break;
+        }
+        if (rv == 1) res->reapplied++;
+        if (rv == 0) res->broken++;
+        if (rv == -1) res->corrupt++;
+        res->total++;
+        if (unlink(record) != 0) {
+            ret = -1;
+            break;
+        }
+    }
+    closedir(dir);
+    return ret;
+}
+
+/*
+ *  GC callbacks for JIO::MultiTransaction
+ */
+static void rb_jio_mark_multi(void *ptr)
+{
+    jio_jmulti_wrapper *multi = (jio_jmulti_wrapper *)ptr;
+    if (ptr) rb_gc_mark(multi->files);
+}
+
+static void rb_jio_free_multi_ops(jio_jmulti_wrapper *multi)
+{
+    jio_multi_op *op, *next;
+    for (op = multi->ops; op != NULL; op = next) {
+        next = op->next;
+        jio_multi_free_op(op);
+    }
+    multi->ops = multi->last = NULL;
+    multi->numops = 0;
+}
+
+static void rb_jio_free_multi(void *ptr)
+{
+    jio_jmulti_wrapper *multi = (jio_jmulti_wrapper *)ptr;
+    if (multi) {
+        rb_jio_free_multi_ops(multi);
+        xfree(multi);
+    }
+}
+
+static long jio_multi_file_index(jio_jmulti_wrapper *multi, VALUE file)
+{
+    long idx;
+    for (idx = 0; idx < RARRAY_LEN(multi->files); idx++) {
+        if (rb_ary_entry(multi->files, idx) == file) return idx;
+    }
+    rb_raise(rb_eArgError, "file is not part of this transaction");
+    return -1;
+}
+
+static void jio_multi_push_op(jio_jmulti_wrapper *multi, jio_multi_op *op)
+{
+    op->next = NULL;
+    if (multi->last == NULL) {
+        multi->ops = op;
+    } else {
+        multi->last->next = op;
+    }
+    multi->last = op;
+    multi->numops++;
+}
+
+/*
+ *  call-seq:
+ *     JIO.transaction(file_a, file_b)    =>  JIO::MultiTransaction
+ *
+ *  Creates a transaction spanning several libjio file handles. All write operations are journaled in
+ *  a single record with one sync barrier and applied atomically with regards to JIO.check on the first
+ *  file.
+ *
+ * === Examples
+ *     JIO.transaction(file_a, file_b)    =>  JIO::MultiTransaction
+ *
+*/
+
+static VALUE rb_jio_s_transaction(int argc, VALUE *argv, JIO_UNUSED VALUE jio)
+{
+    int i;
+    VALUE transaction;
+    jio_jmulti_wrapper *multi = NULL;
+    if (argc == 0) rb_raise(rb_eArgError, "at least one JIO::File expected");
+    for (i = 0; i < argc; i++) {
+        JioAssertFile(argv[i]);
+    }
+    transaction = Data_Make_Struct(rb_cJioMultiTransaction, jio_jmulti_wrapper, rb_jio_mark_multi, rb_jio_free_multi, multi);
+    multi->files = rb_ary_new();
+    for (i = 0; i < argc; i++) {
+        if (!RTEST(rb_ary_includes(multi->files, argv[i]))) rb_ary_push(multi->files, argv[i]);
+    }
+    multi->ops = multi->last = NULL;
+    multi->numops = 0;
+    multi->flags = 0;
+    rb_obj_call_init(transaction, 0, NULL);
+    return transaction;
+}
+
+/*
+ *  call-seq:
+ *     transaction.write(file, "data", 2)    =>  boolean
+ *
+ *  Spawns a write operation from a given buffer to X offset of a participating file. Only written to
+ *  disk when the transaction has been committed. Operations will be applied in order, and overlapping
+ *  operations are permitted, in which case the latest one will prevail.
+ *
+ * === Examples
+ *     transaction.write(file, "data", 2)    =>  boolean
+ *
+*/
+
+static VALUE rb_jio_multi_write(VALUE obj, VALUE file, VALUE buf, VALUE offset)
+{
+    long idx;
+    jio_multi_op *op = NULL;
+    JioGetMultiTransaction(obj);
+    JioAssertFile(file);
+    Check_Type(buf, T_STRING);
+    AssertOffset(offset);
+    if (multi->flags & JIO_MULTI_RELEASED) rb_raise(rb_eIOError, "JIO multi transaction already released");
+    if (RSTRING_LEN(buf) == 0) rb_raise(rb_eArgError, "empty write operation");
+    idx = jio_multi_file_index(multi, file);
+    op = ALLOC(jio_multi_op);
+    op->idx = (uint32_t)idx;
+    op->offset = (off_t)NUM2OFFT(offset);
+    op->len = (size_t)RSTRING_LEN(buf);
+    op->buf = ALLOC_N(char, op->len);
+    memcpy(op->buf, RSTRING_PTR(buf), op->len);
+    op->src_fd = -1;
+    op->src_offset = op->rec_offset = 0;
+    op->seq = 0;
+    jio_multi_push_op(multi, op);
+    return Qtrue;
+}
+
+/*
+ *  call-seq:
+ *     transaction.write_from(file, "/path/blob", 2, 4096)    =>  boolean
+ *
+ *  Spawns a write operation of X bytes from a source path or IO to Y offset of a participating file.
+ *  The data is streamed through the journal in fixed size chunks at commit time, so memory usage stays
+ *  constant regardless of the transaction size.
+ *
+ * === Examples
+ *     transaction.write_from(file, "/path/blob", 2, 4096)    =>  boolean
+ *
+*/
+
+static VALUE rb_jio_multi_write_from(VALUE obj, VALUE file, VALUE source, VALUE offset, VALUE length)
+{
+    long idx;
+    jio_multi_op *op = NULL;
+    JioGetMultiTransaction(obj);
+    JioAssertFile(file);
+    if (multi->flags & JIO_MULTI_RELEASED) rb_raise(rb_eIOError, "JIO multi transaction already released");
+    idx = jio_multi_file_index(multi, file);
+    op = jio_multi_stream_op(source, offset, length);
+    op->idx = (uint32_t)idx;
+    jio_multi_push_op(multi, op);
+    return Qtrue;
+}
+
+/*
+ *  call-seq:
+ *     transaction.commit    =>  boolean
+ *
+ *  Journals all write operations in one record, syncs it once and applies the operations to each file.
+ *  After this function returns successfully, all the data can be trusted to be on the disk. Other
+ *  threads keep running while it blocks on disk I/O.
+ *
+ * === Examples
+ *     transaction.commit    =>  boolean
+ *
+*/
+
+typedef struct {
+    jio_jmulti_wrapper *multi;
+    jfs_t **fss;
+    char **paths;
+    long nfiles;
+    int ret;
+} jio_multi_commit_args;
+
+static void *jio_multi_commit_nogvl(void *ptr)
+{
+    jio_multi_commit_args *args = (jio_multi_commit_args *)ptr;
+    args->ret = jio_multi_commit(args->multi, args->fss, args->paths, args->nfiles);
+    return NULL;
+}
+
+/*
+ *  Releases the first n participating files, held for the duration of a commit
+ */
+static void jio_multi_release_files(jio_jmulti_wrapper *multi, long n)
+{
+    long i;
+    jio_jfs_wrapper *file = NULL;
+    for (i = 0; i < n; i++) {
+        JioFileStruct(rb_ary_entry(multi->files, i), file);
+        jio_file_release(file);
+    }
+}
+
+static VALUE rb_jio_multi_commit(VALUE obj)
+{
+    int ret, err, relock = 0;
+    jio_multi_commit_args args;
+    long i, nfiles;
+    jfs_t **fss = NULL;
+    char **paths = NULL;
+    jio_jfs_wrapper *file = NULL;
+    JioGetMultiTransaction(obj);
+    if (multi->flags & JIO_MULTI_RELEASED) rb_raise(rb_eIOError, "JIO multi transaction already released");
+    if (multi->numops == 0) rb_raise(rb_eIOError, "JIO multi transaction error on commit (no operations)");
+    nfiles = RARRAY_LEN(multi->files);
+    fss = ALLOCA_N(jfs_t *, nfiles);
+    paths = ALLOCA_N(char *, nfiles);
+    for (i = 0; i < nfiles; i++) {
+        JioFileStruct(rb_ary_entry(multi->files, i), file);
+        if (jio_file_hold(file) != 0) {
+            jio_multi_release_files(multi, i);
+            rb_raise(rb_eIOError, "closed JIO::File in transaction");
+        }
+        if (file->fs->flags & J_RDONLY) {
+            jio_multi_release_files(multi, i + 1);
+            rb_raise(rb_eIOError, "read-only JIO::File in transaction");
+        }
+        fss[i] = file->fs;
+        paths[i] = file->path;
+        JioFileWritten(file);
+        if (jio_dirty_note_ops(file, NULL, multi->ops, i, 1) != 0) {
+            jio_multi_release_files(multi, i + 1);
+            rb_sys_fail("JIO multi transaction error on commit (dirty log)");
+        }
+    }
+    args.multi = multi;
+    args.fss = fss;
+    args.paths = paths;
+    args.nfiles = nfiles;
+    jio_blocking_call(jio_multi_commit_nogvl, &args);
+    ret = args.ret;
+    for (i = 0; i < nfiles; i++) {
+        JioFileStruct(rb_ary_entry(multi->files, i), file);
+        /* readers may have refilled from the old data meanwhile */
+        JioFileWritten(file);
+        err = jio_map_relock(file);
+        if (relock == 0) relock = err;
+        if (ret >= 0) {
+            jio_dirty_note_ops(file, NULL, multi->ops, i, 0);
+            jio_direct_dontneed_ops(file, NULL, multi->ops, i);
+        }
+    }
+    jio_multi_release_files(multi, nfiles);
+    if (ret == -1) rb_sys_fail("JIO multi transaction error on commit (atomic warranties preserved)");
+    if (ret == -2) rb_sys_fail("JIO multi transaction error on commit (atomic warranties broken)");
+    multi->flags |= JIO_MULTI_COMMITTED;
+    jio_map_check_relock(relock);
+    return Qtrue;
+}
+
+/*
+ *  call-seq:
+ *     transaction.release    =>  nil
+ *
+ *  Free all transaction state and operation buffers
+ *
+ * === Examples
+ *     transaction.release    =>  nil
+ *
+*/
+
+static VALUE rb_jio_multi_release(VALUE obj)
+{
+    JioGetMultiTransaction(obj);
+    rb_jio_free_multi_ops(multi);
+    multi->flags |= JIO_MULTI_RELEASED;
+    return Qnil;
+}
+
+/*
+ *  call-seq:
+ *     transaction.committed?    =>  boolean
+ *
+ *  Determines if this transaction has been committed.
+ *
+ * === Examples
+ *     transaction.committed?    =>  boolean
+ *
+*/
+
+static VALUE rb_jio_multi_committed_p(VALUE obj)
+{
+    JioGetMultiTransaction(obj);
+    return (multi->flags & JIO_MULTI_COMMITTED) ? Qtrue : Qfalse;
+}
+
+/*
+ *  call-seq:
+ *     transaction.files    =>  Array
+ *
+ *  Returns the files participating in this transaction. The first one is the coordinator, which holds
+ *  the journal record.
+ *
+ * === Examples
+ *     transaction.files    =>  Array
+ *
+*/
+
+static VALUE rb_jio_multi_files(VALUE obj)
+{
+    JioGetMultiTransaction(obj);
+    return rb_ary_dup(multi->files);
+}
+
+void _init_rb_jio_multi()
+{
+    rb_define_module_function(mJio, "transaction", rb_jio_s_transaction, -1);
+
+    rb_cJioMultiTransaction = rb_define_class_under(mJio, "MultiTransaction", rb_cObject);
+
+    rb_define_method(rb_cJioMultiTransaction, "write", rb_jio_multi_write, 3);
+    rb_define_method(rb_cJioMultiTransaction, "write_from", rb_jio_multi_write_from, 4);
+    rb_define_method(rb_cJioMultiTransaction, "commit", rb_jio_multi_commit, 0);
+    rb_define_method(rb_cJioMultiTransaction, "release", rb_jio_multi_release, 0);
+    rb_define_method(rb_cJioMultiTransaction, "committed?", rb_jio_multi_committed_p, 0);
+    rb_define_method(rb_cJioMultiTransaction, "files", rb_jio_multi_files, 0);
+}
@@ -0,0 +1,48 @@
+#ifndef JIO_MULTI_H
+#define JIO_MULTI_H
+
+#define JIO_MULTI_COMMITTED 0x01
+#define JIO_MULTI_RELEASED 0x02
+
+/* Magic prefix for multi file transaction records in the coordinator's journal directory */
+#define JIO_MULTI_MAGIC "JIOM"
+#define JIO_MULTI_PREFIX "multi-"
+
+/* Streamed operations (write_from) are copied through a fixed size buffer instead of being held in memory */
+#define JIO_STREAM_BUFSIZ (1024 * 1024)
+
+typedef struct jio_multi_op {
+    uint32_t idx;
+    off_t offset;
+    size_t len;
+    char *buf;
+    int src_fd;
+    off_t src_offset;
+    off_t rec_offset;
+    unsigned int seq;
+    struct jio_multi_op *next;
+} jio_multi_op;
+
+typedef struct {
+    VALUE files;
+    jio_multi_op *ops;
+    jio_multi_op *last;
+    unsigned int numops;
+    int flags;
+} jio_jmulti_wrapper;
+
+#define JioAssertMultiTransaction(obj) JioAssertType(obj, rb_cJioMultiTransaction, "JIO::MultiTransaction")
+#define JioGetMultiTransaction(obj) \
+    jio_jmulti_wrapper *multi = NULL; \
+    JioAssertMultiTransaction(obj); \
+    Data_Get_Struct(obj, jio_jmulti_wrapper, multi); \
+    if (!multi) rb_raise(rb_eTypeError, "uninitialized JIO multi transaction handle!");
+
+int jio_multi_commit(jio_jmulti_wrapper *multi, jfs_t **fss, char **paths, long nfiles);
+int jio_multi_recover(const char *name, const char *jdir, struct jfsck_result *res);
+jio_multi_op *jio_multi_stream_op(VALUE source, VALUE offset, VALUE length);
+void jio_multi_free_op(jio_multi_op *op);
+
+void _init_rb_jio_multi();
+
+#endif
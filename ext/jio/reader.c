@@ -0,0 +1,316 @@
+#include "jio_ext.h"
+
+/*
+ *  GC callbacks for JIO::Reader
+ */
+static void rb_jio_mark_reader(void *ptr)
+{
+    jio_reader_wrapper *reader = (jio_reader_wrapper *)ptr;
+    if (ptr) rb_gc_mark(reader->file);
+}
+
+static void rb_jio_free_reader(void *ptr)
+{
+    jio_reader_wrapper *reader = (jio_reader_wrapper *)ptr;
+    if (reader) {
+        if (reader->buf != NULL) xfree(reader->buf);
+        xfree(reader);
+    }
+}
+
+/*
+ *  The buffer holds file data from offset onwards, of which len bytes are valid and the first pos
+ *  bytes consumed already. Any write through the underlying handle drops the buffered data.
+ */
+static jio_jfs_wrapper *jio_reader_file(jio_reader_wrapper *reader)
+{
+    jio_jfs_wrapper *file = NULL;
+    JioFileStruct(reader->file, file);
+    if (file->flags & JIO_FILE_CLOSED) rb_raise(rb_eIOError, "closed JIO::File");
+    if (reader->wgen != file->wgen) {
+        reader->offset += reader->pos;
+        reader->len = reader->pos = 0;
+        reader->wgen = file->wgen;
+    }
+    return file;
+}
+
+/*
+ *  Moves unconsumed data to the front of the buffer and refills the rest with jpread. Returns the
+ *  number of bytes read, 0 at end of file.
+ */
+static size_t jio_reader_fill(jio_reader_wrapper *reader)
+{
+    jio_jfs_wrapper *file = jio_reader_file(reader);
+    ssize_t bytes;
+    if (reader->pos > 0) {
+        memmove(reader->buf, reader->buf + reader->pos, reader->len - reader->pos);
+        reader->offset += reader->pos;
+        reader->len -= reader->pos;
+        reader->pos = 0;
+    }
+    if (reader->len == reader->size) return 0;
+    JioHoldFile(file);
+    TRAP_BEG;
+    bytes = jio_file_pread(file, reader->buf + reader->len, reader->size - reader->len, reader->offset + reader->len);
+    TRAP_END;
+    jio_file_release(file);
+    if (bytes == -1) rb_sys_fail("jpread");
+    reader->len += (size_t)bytes;
+    return (size_t)bytes;
+}
+
+static inline size_t jio_reader_avail(jio_reader_wrapper *reader)
+{
+    jio_reader_file(reader);
+    if (reader->pos == reader->len && jio_reader_fill(reader) == 0) return 0;
+    return reader->len - reader->pos;
+}
+
+static VALUE jio_reader_consume(jio_reader_wrapper *reader, VALUE str, size_t len)
+{
+    if (NIL_P(str)) {
+        str = rb_str_new(reader->buf + reader->pos, (long)len);
+    } else {
+        rb_str_cat(str, reader->buf + reader->pos, (long)len);
+    }
+    reader->pos += len;
+    return str;
+}
+
+/*
+ *  call-seq:
+ *     JIO::Reader.new(file, 65536)    =>  JIO::Reader
+ *
+ *  Returns a buffered reader over a libjio file handle, starting at offset 0. Data is read in chunks
+ *  of the given buffer size through jpread, independent of the handle's file position.
+ *
+ * === Examples
+ *     JIO::Reader.new(file)    =>  JIO::Reader
+ *     JIO::Reader.new(file, 1024 * 1024)    =>  JIO::Reader
+ *
+*/
+
+static VALUE rb_jio_s_reader_new(int argc, VALUE *argv, JIO_UNUSED VALUE klass)
+{
+    VALUE obj, file, size;
+    jio_reader_wrapper *reader = NULL;
+    rb_scan_args(argc, argv, "11", &file, &size);
+    JioAssertFile(file);
+    if (NIL_P(size)) size = INT2FIX(JIO_READER_BUFSIZ);
+    AssertLength(size);
+    if (size == jio_zero) rb_raise(rb_eArgError, "buffer size must be > 0");
+    if (!NIL_P(rb_rs) && RSTRING_LEN(rb_rs) > FIX2LONG(size)) rb_raise(rb_eArgError, "buffer size must be >= the length of $/");
+    obj = Data_Make_Struct(rb_cJioReader, jio_reader_wrapper, rb_jio_mark_reader, rb_jio_free_reader, reader);
+    reader->file = file;
+    reader->size = (size_t)FIX2LONG(size);
+    reader->buf = xmalloc(reader->size);
+    reader->len = reader->pos = 0;
+    reader->offset = 0;
+    jio_reader_file(reader);
+    rb_obj_call_init(obj, 0, NULL);
+    return obj;
+}
+
+/*
+ *  call-seq:
+ *     reader.gets    =>  String or nil
+ *
+ *  Reads the next line, including the separator, or the rest of the file if the separator is nil.
+ *  Returns nil at end of file. Raises ArgumentError if the separator is longer than the buffer.
+ *
+ * === Examples
+ *     reader.gets    =>  String or nil
+ *     reader.gets("\0")    =>  String or nil
+ *
+*/
+
+static VALUE rb_jio_reader_gets(int argc, VALUE *argv, VALUE obj)
+{
+    VALUE sep, line = Qnil;
+    const char *sepp = NULL, *hit;
+    size_t seplen = 0, avail, keep;
+    JioGetReader(obj);
+    if (rb_scan_args(argc, argv, "01", &sep) == 0) sep = rb_rs;
+    if (!NIL_P(sep)) {
+        Check_Type(sep, T_STRING);
+        if (RSTRING_LEN(sep) == 0) rb_raise(rb_eArgError, "empty separator");
+        sepp = RSTRING_PTR(sep);
+        seplen = (size_t)RSTRING_LEN(sep);
+        /* a separator has to fit the buffer whole, or it could never be matched */
+        if (seplen > reader->size) rb_raise(rb_eArgError, "separator longer than the buffer size");
+    }
+    while ((avail = jio_reader_avail(reader)) > 0) {
+        if (seplen > 0 && avail >= seplen) {
+            hit = memmem(reader->buf + reader->pos, avail, sepp, seplen);
+            if (hit != NULL) {
+                line = jio_reader_consume(reader, line, (size_t)(hit - (reader->buf + reader->pos)) + seplen);
+                return JioEncode(line);
+            }
+        }
+        /* hold back a partial separator spanning the buffer boundary */
+        keep = seplen > 1 ? seplen - 1 : 0;
+        if (keep > avail) keep = avail;
+        if (avail > keep) line = jio_reader_consume(reader, line, avail - keep);
+        if (keep > 0 && jio_reader_fill(reader) == 0) line = jio_reader_consume(reader, line, reader->len - reader->pos);
+    }
+    return NIL_P(line) ? Qnil : JioEncode(line);
+}
+
+/*
+ *  call-seq:
+ *     reader.each_line{|line| }    =>  JIO::Reader
+ *
+ *  Yields each remaining line. Returns an Enumerator if no block is given.
+ *
+ * === Examples
+ *     reader.each_line{|line| }    =>  JIO::Reader
+ *     reader.each_line("\0").to_a    =>  Array
+ *
+*/
+
+static VALUE rb_jio_reader_each_line(int argc, VALUE *argv, VALUE obj)
+{
+    VALUE line;
+    RETURN_ENUMERATOR(obj, argc, argv);
+    while (!NIL_P(line = rb_jio_reader_gets(argc, argv, obj))) rb_yield(line);
+    return obj;
+}
+
+/*
+ *  call-seq:
+ *     reader.readpartial(1024)    =>  String
+ *
+ *  Returns up to the given number of bytes, issuing at most one read when the buffer is empty.
+ *  Raises EOFError at end of file. Regular files never block, so read_nonblock is an alias.
+ *
+ * === Examples
+ *     reader.readpartial(1024)    =>  String
+ *
+*/
+
+static VALUE rb_jio_reader_readpartial(VALUE obj, VALUE length)
+{
+    size_t avail, len;
+    JioGetReader(obj);
+    AssertLength(length);
+    len = (size_t)FIX2LONG(length);
+    if (len == 0) return JioEncode(rb_str_new(0, 0));
+    avail = jio_reader_avail(reader);
+    if (avail == 0) rb_raise(rb_eEOFError, "end of file reached");
+    return JioEncode(jio_reader_consume(reader, Qnil, len < avail ? len : avail));
+}
+
+/*
+ *  call-seq:
+ *     reader.getbyte    =>  Fixnum or nil
+ *
+ *  Returns the next byte, nil at end of file.
+ *
+ * === Examples
+ *     reader.getbyte    =>  Fixnum or nil
+ *
+*/
+
+static VALUE rb_jio_reader_getbyte(VALUE obj)
+{
+    JioGetReader(obj);
+    if (jio_reader_avail(reader) == 0) return Qnil;
+    return INT2FIX((unsigned char)reader->buf[reader->pos++]);
+}
+
+/*
+ *  call-seq:
+ *     reader.pos    =>  Fixnum
+ *
+ *  Returns the offset of the next byte to be read.
+ *
+ * === Examples
+ *     reader.pos    =>  Fixnum
+ *
+*/
+
+static VALUE rb_jio_reader_pos(VALUE obj)
+{
+    JioGetReader(obj);
+    return OFFT2NUM(reader->offset + (off_t)reader->pos);
+}
+
+/*
+ *  call-seq:
+ *     reader.seek(10)    =>  Fixnum
+ *
+ *  Moves the read position to a given offset. Buffered data is kept if the offset falls within it.
+ *
+ * === Examples
+ *     reader.seek(10)    =>  Fixnum
+ *
+*/
+
+static VALUE rb_jio_reader_seek(VALUE obj, VALUE offset)
+{
+    off_t off;
+    JioGetReader(obj);
+    AssertOffset(offset);
+    off = (off_t)NUM2OFFT(offset);
+    jio_reader_file(reader);
+    if (off >= reader->offset && off <= reader->offset + (off_t)reader->len) {
+        reader->pos = (size_t)(off - reader->offset);
+    } else {
+        reader->offset = off;
+        reader->len = reader->pos = 0;
+    }
+    return offset;
+}
+
+/*
+ *  call-seq:
+ *     reader.eof?    =>  boolean
+ *
+ *  Determines if the read position is at end of file.
+ *
+ * === Examples
+ *     reader.eof?    =>  boolean
+ *
+*/
+
+static VALUE rb_jio_reader_eof_p(VALUE obj)
+{
+    JioGetReader(obj);
+    return jio_reader_avail(reader) == 0 ? Qtrue : Qfalse;
+}
+
+/*
+ *  call-seq:
+ *     reader.file    =>  JIO::File
+ *
+ *  Returns the underlying libjio file handle.
+ *
+ * === Examples
+ *     reader.file    =>  JIO::File
+ *
+*/
+
+static VALUE rb_jio_reader_file(VALUE obj)
+{
+    JioGetReader(obj);
+    return reader->file;
+}
+
+void _init_rb_jio_reader()
+{
+    rb_cJioReader = rb_define_class_under(mJio, "Reader", rb_cObject);
+
+    rb_define_const(rb_cJioReader, "BUFSIZ", INT2NUM(JIO_READER_BUFSIZ));
+
+    rb_define_singleton_method(rb_cJioReader, "new", rb_jio_s_reader_new, -1);
+    rb_define_method(rb_cJioReader, "gets", rb_jio_reader_gets, -1);
+    rb_define_method(rb_cJioReader, "each_line", rb_jio_reader_each_line, -1);
+    rb_define_method(rb_cJioReader, "readpartial", rb_jio_reader_readpartial, 1);
+    rb_define_method(rb_cJioReader, "read_nonblock", rb_jio_reader_readpartial, 1);
+    rb_define_method(rb_cJioReader, "getbyte", rb_jio_reader_getbyte, 0);
+    rb_define_method(rb_cJioReader, "pos", rb_jio_reader_pos, 0);
+    rb_define_method(rb_cJioReader, "seek", rb_jio_reader_seek, 1);
+    rb_define_method(rb_cJioReader, "eof?", rb_jio_reader_eof_p, 0);
+    rb_define_method(rb_cJioReader, "file", rb_jio_reader_file, 0);
+}
@@ -0,0 +1,26 @@
+#ifndef JIO_READER_H
+#define JIO_READER_H
+
+/* Default JIO::Reader buffer size */
+#define JIO_READER_BUFSIZ (64 * 1024)
+
+typedef struct {
+    VALUE file;
+    char *buf;
+    size_t size;
+    size_t len;
+    size_t pos;
+    off_t offset;
+    unsigned long wgen;
+} jio_reader_wrapper;
+
+#define JioAssertReader(obj) JioAssertType(obj, rb_cJioReader, "JIO::Reader")
+#define JioGetReader(obj) \
+    jio_reader_wrapper *reader = NULL; \
+    JioAssertReader(obj); \
+    Data_Get_Struct(obj, jio_reader_wrapper, reader); \
+    if (!reader) rb_raise(rb_eTypeError, "uninitialized JIO reader handle!");
+
+void _init_rb_jio_reader();
+
+#endif
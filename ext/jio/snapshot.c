@@ -0,0 +1,369 @@
+#include "jio_ext.h"
+
+/*
+ *  Builds the dirty log path for a file, .<name>.dirty in the file's directory
+ */
+static int jio_dirty_path(const char *name, char *path)
+{
+    const char *base = strrchr(name, '/');
+    int dirlen = base ? (int)(base - name) + 1 : 0;
+    base = base ? base + 1 : name;
+    return (snprintf(path, PATH_MAX, "%.*s.%s%s", dirlen, name, base, JIO_DIRTY_SUFFIX) < PATH_MAX) ? 0 : -1;
+}
+
+/*
+ *  Starts feeding the dirty log from this handle. Without create, a missing log isn't an error - the
+ *  file simply isn't tracked until a handle is opened with JIO::J_TRACK.
+ */
+int jio_dirty_open(jio_jfs_wrapper *file, int create)
+{
+    char path[PATH_MAX];
+    int fd;
+    if (file->dirty_fd >= 0) return 0;
+    if (jio_dirty_path(file->fs->name, path) != 0) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    fd = open(path, O_RDWR | O_APPEND | (create ? O_CREAT : 0), 0600);
+    if (fd < 0) return (!create && errno == ENOENT) ? 0 : -1;
+    file->dirty_fd = fd;
+    return 0;
+}
+
+void jio_dirty_close(jio_jfs_wrapper *file)
+{
+    if (file->dirty_fd >= 0) close(file->dirty_fd);
+    file->dirty_fd = -1;
+}
+
+/*
+ *  Appends extents to the dirty log. Writers note their extents synchronously before committing, so
+ *  a crash can only leave extra extents behind, and again after committing, so an export running
+ *  concurrently with the commit can't consume the extents while the region still holds the old data.
+ */
+int jio_dirty_note(jio_jfs_wrapper *file, const jio_extent *exts, long n, int sync)
+{
+    unsigned char *buf;
+    uint64_t val;
+    size_t len;
+    ssize_t rv;
+    long i;
+    if (file->dirty_fd < 0 || n == 0) return 0;
+    len = (size_t)n * JIO_DIRTY_RECSIZ;
+    buf = malloc(len);
+    if (buf == NULL) return -1;
+    for (i = 0; i < n; i++) {
+        val = htonll(exts[i].offset);
+        memcpy(buf + i * JIO_DIRTY_RECSIZ, &val, sizeof(uint64_t));
+        val = htonll(exts[i].len);
+        memcpy(buf + i * JIO_DIRTY_RECSIZ + sizeof(uint64_t), &val, sizeof(uint64_t));
+    }
+    rv = write(file->dirty_fd, buf, len);
+    free(buf);
+    if (rv != (ssize_t)len) return -1;
+    return sync ? fdatasync(file->dirty_fd) : 0;
+}
+
+/*
+ *  Notes a plain write. A negative offset stands for the handle's file pointer, as used by jwrite.
+ */
+int jio_dirty_note_write(jio_jfs_wrapper *file, off_t offset, size_t len, int sync)
+{
+    jio_extent ext;
+    if (file->dirty_fd < 0) return 0;
+    if (offset < 0) offset = lseek(file->fs->fd, 0, (file->fs->open_flags & O_APPEND) ? SEEK_END : SEEK_CUR);
+    if (offset < 0) return -1;
+    ext.offset = (uint64_t)offset;
+    ext.len = (uint64_t)len;
+    return jio_dirty_note(file, &ext, 1, sync);
+}
+
+/*
+ *  Notes the write operations of a libjio transaction and a list of multi file (or streamed)
+ *  operations. Only operations on the file at idx are noted from the latter, all of them if idx < 0.
+ */
+int jio_dirty_note_ops(jio_jfs_wrapper *file, struct operation *op, jio_multi_op *mop, long idx, int sync)
+{
+    jio_extent *exts;
+    struct operation *o;
+    jio_multi_op *m;
+    long n = 0;
+    int ret;
+    if (file->dirty_fd < 0) return 0;
+    for (o = op; o != NULL; o = o->next) if (o->direction == D_WRITE) n++;
+    for (m = mop; m != NULL; m = m->next) if (idx < 0 || (long)m->idx == idx) n++;
+    if (n == 0) return 0;
+    exts = malloc(n * sizeof(jio_extent));
+    if (exts == NULL) return -1;
+    n = 0;
+    for (o = op; o != NULL; o = o->next) {
+        if (o->direction != D_WRITE) continue;
+        exts[n].offset = (uint64_t)o->offset;
+        exts[n++].len = (uint64_t)o->len;
+    }
+    for (m = mop; m != NULL; m = m->next) {
+        if (idx >= 0 && (long)m->idx != idx) continue;
+        exts[n].offset = (uint64_t)m->offset;
+        exts[n++].len = (uint64_t)m->len;
+    }
+    ret = jio_dirty_note(file, exts, n, sync);
+    free(exts);
+    return ret;
+}
+
+static int jio_extent_cmp(const void *a, const void *b)
+{
+    const jio_extent *x = (const jio_extent *)a, *y = (const jio_extent *)b;
+    if (x->offset != y->offset) return (x->offset < y->offset) ? -1 : 1;
+    return 0;
+}
+
+/*
+ *  Copies the first size bytes of a file - as a reflink where the filesystem supports it, in kernel
+ *  space with copy_file_range(2) otherwise, falling back to a read / write loop.
+ */
+static int jio_snapshot_copy(int src, int dst, off_t size)
+{
+    char *buf;
+    ssize_t rv;
+    size_t want;
+    off_t pos = 0;
+#ifdef FICLONE
+    if (ioctl(dst, FICLONE, src) == 0) return 0;
+#endif
+#ifdef HAVE_COPY_FILE_RANGE
+    {
+        loff_t soff = 0, doff = 0;
+        while (soff < size) {
+            rv = copy_file_range(src, &soff, dst, &doff, (size_t)(size - soff), 0);
+            if (rv <= 0) break;
+        }
+        if (soff == size) return 0;
+        /* the destination matches up to here, as both offsets advance together */
+        pos = soff;
+    }
+#endif
+    buf = malloc(JIO_EXPORT_BUFSIZ);
+    if (buf == NULL) return -1;
+    while (pos < size) {
+        want = (size - pos > JIO_EXPORT_BUFSIZ) ? JIO_EXPORT_BUFSIZ : (size_t)(size - pos);
+        rv = spread(src, buf, want, pos);
+        if (rv <= 0 || spwrite(dst, buf, (size_t)rv, pos) != rv) {
+            if (rv == 0) errno = EIO;
+            free(buf);
+            return -1;
+        }
+        pos += rv;
+    }
+    free(buf);
+    return 0;
+}
+
+/*
+ *  call-seq:
+ *     file.snapshot_to("/backup/file")    =>  Fixnum
+ *
+ *  Takes a point-in-time copy of the file while writers carry on. Lingering transactions are synced
+ *  first, then the whole file is read locked for the duration of the copy. That's near instant where
+ *  the filesystem supports reflinks, but otherwise lasts as long as copying the file with
+ *  copy_file_range(2) takes, and commits from other processes wait meanwhile. Returns a marker for
+ *  File#export_since.
+ *
+ *  Tracking is opt in: the regions written are logged next to the file in .<name>.dirty, from the
+ *  first time a handle is opened with JIO::J_TRACK. Handles opened once the log exists feed it as well,
+ *  but writers opened before then don't, so open them all with JIO::J_TRACK. Raises IOError if the
+ *  file isn't tracked.
+ *
+ *  The read lock fences commits at any offset, as the bundled libjio locks each operation's range.
+ *  As fcntl locks are per process, it only keeps out commits from other processes though. Writes from
+ *  the same process during the copy are logged past the returned marker, so the next export covers
+ *  them.
+ *
+ * === Examples
+ *     file.snapshot_to("/backup/file")    =>  Fixnum
+ *
+*/
+
+static VALUE rb_jio_file_snapshot_to(VALUE obj, VALUE path)
+{
+    int dst, ret, err = 0;
+    struct stat st;
+    off_t marker = 0, size = 0;
+    JioGetFile(obj);
+    Check_Type(path, T_STRING);
+    JioHoldFile(file);
+    pthread_mutex_lock(&file->lock);
+    ret = jio_dirty_open(file, 0);
+    pthread_mutex_unlock(&file->lock);
+    if (ret != 0 || file->dirty_fd < 0) {
+        jio_file_release(file);
+        if (ret == 0) rb_raise(rb_eIOError, "file not tracked, open it with JIO::J_TRACK");
+        rb_sys_fail("open dirty log");
+    }
+    TRAP_BEG;
+    ret = jsync(file->fs);
+    TRAP_END;
+    if (ret != 0 || fstat(file->fs->fd, &st) != 0) {
+        jio_file_release(file);
+        rb_sys_fail(ret != 0 ? "jsync" : "fstat");
+    }
+    dst = open(RSTRING_PTR(path), O_WRONLY | O_CREAT | O_TRUNC, st.st_mode & 0777);
+    if (dst < 0) {
+        jio_file_release(file);
+        rb_sys_fail(RSTRING_PTR(path));
+    }
+    TRAP_BEG;
+    ret = plockf(file->fs->fd, F_LOCKR, 0, 0);
+    TRAP_END;
+    if (ret != 0) {
+        err = errno;
+        close(dst);
+        unlink(RSTRING_PTR(path));
+        jio_file_release(file);
+        errno = err;
+        rb_sys_fail("plockf");
+    }
+    TRAP_BEG;
+    if (fstat(file->dirty_fd, &st) == 0) {
+        marker = st.st_size - st.st_size % JIO_DIRTY_RECSIZ;
+        if (fstat(file->fs->fd, &st) == 0) {
+            size = st.st_size;
+            if (jio_snapshot_copy(file->fs->fd, dst, size) != 0) err = errno;
+        } else {
+            err = errno;
+        }
+    } else {
+        err = errno;
+    }
+    pthread_mutex_lock(&file->lock);
+    jio_map_unlock_range(file, NULL, 0, -1);
+    pthread_mutex_unlock(&file->lock);
+    if (err == 0 && fsync(dst) != 0) err = errno;
+    TRAP_END;
+    close(dst);
+    jio_file_release(file);
+    if (err != 0) {
+        unlink(RSTRING_PTR(path));
+        errno = err;
+        rb_sys_fail("snapshot_to");
+    }
+    return OFFT2NUM(marker);
+}
+
+/*
+ *  call-seq:
+ *     file.export_since(marker){|offset, data| }    =>  Fixnum
+ *
+ *  Yields the current contents of every region written since the snapshot or export that returned
+ *  marker, coalesced and in file order, in chunks of at most 1MB. If the file was truncated in the
+ *  meantime, everything from the truncation point is yielded and a final offset with nil data gives
+ *  the size to truncate the copy to. Returns the marker to pass to the next export. Only the dirty
+ *  log is read up front, so writers aren't blocked.
+ *
+ * === Examples
+ *     file.export_since(marker){|offset, data| data ? copy.pwrite(data, offset) : copy.truncate(offset) }    =>  Fixnum
+ *
+*/
+
+static VALUE rb_jio_file_export_since(VALUE obj, VALUE marker)
+{
+    volatile VALUE recs, buf;
+    struct stat st;
+    off_t from, end, size;
+    uint64_t val, limit, pos, stop;
+    jio_extent *exts;
+    long i, n, m;
+    ssize_t rv;
+    size_t want;
+    int ret, truncated = 0;
+    JioGetFile(obj);
+    RETURN_ENUMERATOR(obj, 1, &marker);
+    from = (off_t)NUM2OFFT(marker);
+    /* the handle is held while reading the log, and then only per chunk read */
+    JioHoldFile(file);
+    pthread_mutex_lock(&file->lock);
+    ret = jio_dirty_open(file, 0);
+    pthread_mutex_unlock(&file->lock);
+    if (ret == 0 && file->dirty_fd < 0) {
+        jio_file_release(file);
+        rb_raise(rb_eIOError, "file not tracked, open it with JIO::J_TRACK");
+    }
+    if (ret != 0 || fstat(file->dirty_fd, &st) != 0) {
+        jio_file_release(file);
+        rb_sys_fail(ret != 0 ? "open dirty log" : "fstat");
+    }
+    end = st.st_size - st.st_size % JIO_DIRTY_RECSIZ;
+    if (from < 0 || from > end || from % JIO_DIRTY_RECSIZ != 0) {
+        jio_file_release(file);
+        rb_raise(rb_eArgError, "invalid snapshot marker");
+    }
+    n = (long)((end - from) / JIO_DIRTY_RECSIZ);
+    if (n == 0) {
+        jio_file_release(file);
+        return OFFT2NUM(end);
+    }
+
+    /* records are decoded in place, the extents being the same size */
+    recs = rb_str_new(0, n * JIO_DIRTY_RECSIZ);
+    exts = (jio_extent *)RSTRING_PTR(recs);
+    if (spread(file->dirty_fd, exts, (size_t)n * JIO_DIRTY_RECSIZ, from) != (ssize_t)n * JIO_DIRTY_RECSIZ) {
+        jio_file_release(file);
+        rb_sys_fail("read dirty log");
+    }
+    ret = fstat(file->fs->fd, &st);
+    jio_file_release(file);
+    if (ret != 0) rb_sys_fail("fstat");
+    size = st.st_size;
+    limit = (uint64_t)size;
+    for (i = 0, m = 0; i < n; i++) {
+        memcpy(&val, &exts[i].offset, sizeof(uint64_t));
+        exts[m].offset = ntohll(val);
+        memcpy(&val, &exts[i].len, sizeof(uint64_t));
+        exts[m].len = ntohll(val);
+        if (exts[m].len == JIO_DIRTY_TRUNCATE) {
+            truncated = 1;
+            exts[m].len = (exts[m].offset < limit) ? limit - exts[m].offset : 0;
+        }
+        if (exts[m].offset >= limit || exts[m].len == 0) continue;
+        if (exts[m].len > limit - exts[m].offset) exts[m].len = limit - exts[m].offset;
+        m++;
+    }
+    qsort(exts, (size_t)m, sizeof(jio_extent), jio_extent_cmp);
+    for (i = 1, n = m ? 1 : 0; i < m; i++) {
+        if (exts[i].offset <= exts[n - 1].offset + exts[n - 1].len) {
+            stop = exts[i].offset + exts[i].len;
+            if (stop > exts[n - 1].offset + exts[n - 1].len) exts[n - 1].len = stop - exts[n - 1].offset;
+        } else {
+            exts[n++] = exts[i];
+        }
+    }
+
+    buf = rb_str_new(0, JIO_EXPORT_BUFSIZ);
+    for (i = 0; i < n; i++) {
+        pos = exts[i].offset;
+        stop = pos + exts[i].len;
+        while (pos < stop) {
+            want = (stop - pos > JIO_EXPORT_BUFSIZ) ? JIO_EXPORT_BUFSIZ : (size_t)(stop - pos);
+            JioHoldFile(file);
+            TRAP_BEG;
+            rv = jio_file_pread(file, RSTRING_PTR(buf), want, (off_t)pos);
+            TRAP_END;
+            jio_file_release(file);
+            if (rv < 0) rb_sys_fail("jpread");
+            /* shrunk since, the truncation is logged past end */
+            if (rv == 0) break;
+            rb_yield_values(2, OFFT2NUM((off_t)pos), JioEncode(rb_str_new(RSTRING_PTR(buf), rv)));
+            pos += (uint64_t)rv;
+        }
+    }
+    if (truncated) rb_yield_values(2, OFFT2NUM(size), Qnil);
+    return OFFT2NUM(end);
+}
+
+void _init_rb_jio_snapshot()
+{
+    rb_define_const(mJio, "J_TRACK", INT2NUM(JIO_J_TRACK));
+
+    rb_define_method(rb_cJioFile, "snapshot_to", rb_jio_file_snapshot_to, 1);
+    rb_define_method(rb_cJioFile, "export_since", rb_jio_file_export_since, 1);
+}
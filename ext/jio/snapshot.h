@@ -0,0 +1,32 @@
+#ifndef JIO_SNAPSHOT_H
+#define JIO_SNAPSHOT_H
+
+/* Regions written through tracked handles are logged next to the file, in .<name>.dirty */
+#define JIO_DIRTY_SUFFIX ".dirty"
+
+/* JIO.open flag, masked off before jopen, that starts the dirty log */
+#define JIO_J_TRACK 0x10000
+
+/* Each dirty log record is a 64 bit offset and length, big endian */
+#define JIO_DIRTY_RECSIZ 16
+
+/* Length of a record that marks a truncation of the file to the record's offset */
+#define JIO_DIRTY_TRUNCATE ((uint64_t)-1)
+
+/* Snapshot copies and File#export_since read the file in chunks of at most this size */
+#define JIO_EXPORT_BUFSIZ (1024 * 1024)
+
+typedef struct {
+    uint64_t offset;
+    uint64_t len;
+} jio_extent;
+
+int jio_dirty_open(jio_jfs_wrapper *file, int create);
+void jio_dirty_close(jio_jfs_wrapper *file);
+int jio_dirty_note(jio_jfs_wrapper *file, const jio_extent *exts, long n, int sync);
+int jio_dirty_note_write(jio_jfs_wrapper *file, off_t offset, size_t len, int sync);
+int jio_dirty_note_ops(jio_jfs_wrapper *file, struct operation *op, jio_multi_op *mop, long idx, int sync);
+
+void _init_rb_jio_snapshot();
+
+#endif
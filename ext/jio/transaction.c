@@ -13,13 +13,38 @@ static inline VALUE rb_jio_transaction_result(ssize_t ret, const char *ctx)
     return INT2NUM(ret);
 }
 
+/*
+ *  Invalidates read buffers over the transaction's file and returns it. Called again once the
+ *  transaction is applied, as readers may refill from the old data while it runs without the GVL.
+ */
+static inline jio_jfs_wrapper *jio_transaction_written(jio_jtrans_wrapper *trans)
+{
+    jio_jfs_wrapper *file = NULL;
+    JioFileStruct(trans->file, file);
+    JioFileWritten(file);
+    return file;
+}
+
 /*
  *  GC callbacks for JIO::Transaction
  */
 void rb_jio_mark_transaction(void *ptr)
 {
     jio_jtrans_wrapper *trans = (jio_jtrans_wrapper *)ptr;
-    if (ptr) rb_gc_mark(trans->views);
+    if (ptr) {
+        rb_gc_mark(trans->file);
+        rb_gc_mark(trans->views);
+    }
+}
+
+static void rb_jio_free_transaction_streams(jio_jtrans_wrapper *trans)
+{
+    jio_multi_op *op, *next;
+    for (op = trans->streams; op != NULL; op = next) {
+        next = op->next;
+        jio_multi_free_op(op);
+    }
+    trans->streams = trans->streams_last = NULL;
 }
 
 void rb_jio_free_transaction(void *ptr)
@@ -27,10 +52,89 @@ void rb_jio_free_transaction(void *ptr)
     jio_jtrans_wrapper *trans = (jio_jtrans_wrapper *)ptr;
     if(trans) {
         if (trans->trans != NULL && !(trans->flags & JIO_TRANSACTION_RELEASED)) jtrans_free(trans->trans);
+        rb_jio_free_transaction_streams(trans);
         xfree(trans);
     }
 }
 
+/*
+ *  Commits a transaction with streamed write operations. libjio transaction files are built in memory,
+ *  so the whole transaction is journaled as a single file record instead (see multi.c), with buffered
+ *  and streamed operations interleaved in the order they were added. Read operations are served once
+ *  the writes have been applied, which is why they can't be followed by writes in such transactions
+ *  (see jio_transaction_assert_write).
+ */
+static ssize_t jio_transaction_stream_commit(jio_jtrans_wrapper *trans, char *path)
+{
+    int ret = -1;
+    unsigned int seq = 0;
+    jtrans_t *t = trans->trans;
+    jfs_t *fs = t->fs;
+    jio_jmulti_wrapper multi;
+    jio_multi_op *mop, *next, *stream = trans->streams, **tail = &multi.ops;
+    struct operation *op = t->op;
+
+    /* shallow copies, so neither libjio's operation list nor the stream list are relinked */
+    multi.numops = 0;
+    for (;;) {
+        while (stream != NULL && stream->seq == seq) {
+            mop = malloc(sizeof(jio_multi_op));
+            if (mop == NULL) goto exit;
+            memcpy(mop, stream, sizeof(jio_multi_op));
+            *tail = mop;
+            tail = &mop->next;
+            multi.numops++;
+            stream = stream->next;
+        }
+        if (op == NULL) break;
+        if (op->direction == D_WRITE) {
+            mop = malloc(sizeof(jio_multi_op));
+            if (mop == NULL) goto exit;
+            mop->idx = 0;
+            mop->offset = op->offset;
+            mop->len = op->len;
+            mop->buf = op->buf;
+            mop->src_fd = -1;
+            *tail = mop;
+            tail = &mop->next;
+            multi.numops++;
+        }
+        op = op->next;
+        seq++;
+    }
+    *tail = NULL;
+
+    ret = jio_multi_commit(&multi, &fs, &path, 1);
+    if (ret != 1) goto exit;
+    for (op = t->op; op != NULL; op = op->next) {
+        if (op->direction != D_READ) continue;
+        if (spread(fs->fd, op->buf, op->len, op->offset) != (ssize_t)op->len) {
+            ret = -1;
+            goto exit;
+        }
+    }
+    t->flags |= J_COMMITTED;
+
+exit:
+    *tail = NULL;
+    for (mop = multi.ops; mop != NULL; mop = next) {
+        next = mop->next;
+        free(mop);
+    }
+    return ret;
+}
+
+/*
+ *  Reads of transactions with streamed operations are only served after all writes, so a read queued
+ *  before any write would see data it shouldn't. Such transactions reject writes past their first read.
+ */
+static void jio_transaction_assert_write(jio_jtrans_wrapper *trans, int streamed)
+{
+    if ((streamed || trans->streams != NULL) && trans->trans->numops_r > 0) {
+        rb_raise(rb_eIOError, "JIO transaction error on write (streamed operations can't follow reads)");
+    }
+}
+
 /*
  *  call-seq:
  *     transaction.read(2, 2)    =>  boolean
@@ -81,7 +185,7 @@ static VALUE rb_jio_transaction_views(VALUE obj)
     JioGetTransaction(obj);
     t = trans->trans;
     if ((t->flags & J_COMMITTED) && !NIL_P(trans->views)) return trans->views;
-    return jio_empty_view;
+    return rb_ary_new();
 }
 
 /*
@@ -103,6 +207,7 @@ static VALUE rb_jio_transaction_write(VALUE obj, VALUE buf, VALUE offset)
     JioGetTransaction(obj);
     Check_Type(buf, T_STRING);
     AssertOffset(offset);
+    jio_transaction_assert_write(trans, 0);
     TRAP_BEG;
     ret = jtrans_add_w(trans->trans, RSTRING_PTR(buf), (size_t)RSTRING_LEN(buf), (off_t)NUM2OFFT(offset));
     TRAP_END;
@@ -110,6 +215,40 @@ static VALUE rb_jio_transaction_write(VALUE obj, VALUE buf, VALUE offset)
     return Qtrue;
 }
 
+/*
+ *  call-seq:
+ *     transaction.write_from("/path/blob", 2, 4096)    =>  boolean
+ *
+ *  Spawns a write operation of X bytes from a source path (read from its start) or IO (read from its
+ *  current position) to Y offset for this transaction. The data is streamed through the journal in
+ *  fixed size chunks at commit time and never held in memory as a whole. Transactions with streamed
+ *  operations are synced on commit and can't be rolled back. Their reads are served after all writes,
+ *  so writes can't be added past a read.
+ *
+ * === Examples
+ *     transaction.write_from("/path/blob", 2, 4096)    =>  boolean
+ *
+*/
+
+static VALUE rb_jio_transaction_write_from(VALUE obj, VALUE source, VALUE offset, VALUE length)
+{
+    jtrans_t *t = NULL;
+    jio_multi_op *op = NULL;
+    JioGetTransaction(obj);
+    t = trans->trans;
+    if (t->flags & J_RDONLY) rb_raise(rb_eIOError, "JIO transaction error on write_from (read-only)");
+    jio_transaction_assert_write(trans, 1);
+    op = jio_multi_stream_op(source, offset, length);
+    op->seq = t->numops_r + t->numops_w;
+    if (trans->streams_last == NULL) {
+        trans->streams = op;
+    } else {
+        trans->streams_last->next = op;
+    }
+    trans->streams_last = op;
+    return Qtrue;
+}
+
 /*
  *  call-seq:
  *     transaction.commit    =>  boolean
@@ -117,19 +256,55 @@ static VALUE rb_jio_transaction_write(VALUE obj, VALUE buf, VALUE offset)
  *  Reads / writes all operations for this transaction to / from disk, in the order they were added.
  *  After this function returns successfully, all the data can be trusted to be on the disk. The commit
  *  is atomic with regards to other processes using libjio, but not accessing directly to the file.
+ *  Other threads keep running while it blocks on disk I/O.
  *
  * === Examples
  *     transaction.commit    =>  boolean
  *
 */
 
+typedef struct {
+    jio_jtrans_wrapper *trans;
+    char *path;
+    ssize_t ret;
+} jio_transaction_commit_args;
+
+static void *jio_transaction_commit_nogvl(void *ptr)
+{
+    jio_transaction_commit_args *args = (jio_transaction_commit_args *)ptr;
+    if (args->trans->streams != NULL) {
+        args->ret = jio_transaction_stream_commit(args->trans, args->path);
+    } else {
+        args->ret = jtrans_commit(args->trans->trans);
+    }
+    return NULL;
+}
+
 static VALUE rb_jio_transaction_commit(VALUE obj)
 {
     ssize_t ret;
+    int relock;
+    jio_transaction_commit_args args;
+    jio_jfs_wrapper *file = NULL;
     JioGetTransaction(obj);
-    TRAP_BEG;
-    ret = jtrans_commit(trans->trans);
-    TRAP_END;
+    file = jio_transaction_written(trans);
+    JioHoldFile(file);
+    if (jio_dirty_note_ops(file, trans->trans->op, trans->streams, -1, 1) != 0) {
+        jio_file_release(file);
+        rb_sys_fail("JIO transaction error on commit (dirty log)");
+    }
+    args.trans = trans;
+    args.path = file->path;
+    jio_blocking_call(jio_transaction_commit_nogvl, &args);
+    ret = args.ret;
+    JioFileWritten(file);
+    relock = jio_map_relock(file);
+    if (ret >= 0) {
+        jio_dirty_note_ops(file, trans->trans->op, trans->streams, -1, 0);
+        jio_direct_dontneed_ops(file, trans->trans->op, trans->streams, -1);
+    }
+    jio_file_release(file);
+    if (ret >= 0) jio_map_check_relock(relock);
     return rb_jio_transaction_result(ret, "commit");
 }
 
@@ -139,7 +314,7 @@ static VALUE rb_jio_transaction_commit(VALUE obj)
  *
  *  This function atomically undoes a previous committed transaction. After its successful return, the
  *  data can be trusted to be on disk. The read operations will be ignored as we only care about on disk
- *  consistency.
+ *  consistency. Raises IOError for transactions with streamed operations.
  *
  * === Examples
  *     transaction.rollback    =>  boolean
@@ -149,11 +324,41 @@ static VALUE rb_jio_transaction_commit(VALUE obj)
 static VALUE rb_jio_transaction_rollback(VALUE obj)
 {
     ssize_t ret;
+    int relock;
     VALUE res;
+    struct operation *op;
+    jio_extent ext;
+    jio_jfs_wrapper *file = NULL;
     JioGetTransaction(obj);
+    /* no previous data is kept for streamed operations, whether committed yet or not */
+    if (trans->streams != NULL) rb_raise(rb_eIOError, "JIO transaction error on rollback (streamed operations)");
+    file = jio_transaction_written(trans);
+    /* rolling back an operation that extended the file truncates it back to where the operation's
+       previous data ended */
+    ext.len = 0;
+    for (op = trans->trans->op; op != NULL; op = op->next) {
+        if (op->direction == D_WRITE && op->plen < op->len && (ext.len == 0 || (uint64_t)(op->offset + op->plen) < ext.offset)) {
+            ext.offset = (uint64_t)(op->offset + op->plen);
+            ext.len = JIO_DIRTY_TRUNCATE;
+        }
+    }
+    JioHoldFile(file);
+    if (jio_dirty_note(file, &ext, ext.len ? 1 : 0, 0) != 0 || jio_dirty_note_ops(file, trans->trans->op, NULL, -1, 1) != 0) {
+        jio_file_release(file);
+        rb_sys_fail("JIO transaction error on rollback (dirty log)");
+    }
     TRAP_BEG;
     ret = jtrans_rollback(trans->trans);
     TRAP_END;
+    JioFileWritten(file);
+    relock = jio_map_relock(file);
+    if (ret >= 0) {
+        jio_dirty_note(file, &ext, ext.len ? 1 : 0, 0);
+        jio_dirty_note_ops(file, trans->trans->op, NULL, -1, 0);
+        jio_direct_dontneed_ops(file, trans->trans->op, NULL, -1);
+    }
+    jio_file_release(file);
+    if (ret >= 0) jio_map_check_relock(relock);
     res = rb_jio_transaction_result(ret, "rollback");
     if (!NIL_P(trans->views)) rb_ary_clear(trans->views);
     return res;
@@ -176,6 +381,7 @@ static VALUE rb_jio_transaction_release(VALUE obj)
     TRAP_BEG;
     jtrans_free(trans->trans);
     TRAP_END;
+    rb_jio_free_transaction_streams(trans);
     trans->flags |= JIO_TRANSACTION_RELEASED;
     return Qnil;
 }
@@ -252,6 +458,7 @@ void _init_rb_jio_transaction()
     rb_define_method(rb_cJioTransaction, "read", rb_jio_transaction_read, 2);
     rb_define_method(rb_cJioTransaction, "views", rb_jio_transaction_views, 0);
     rb_define_method(rb_cJioTransaction, "write", rb_jio_transaction_write, 2);
+    rb_define_method(rb_cJioTransaction, "write_from", rb_jio_transaction_write_from, 3);
     rb_define_method(rb_cJioTransaction, "commit", rb_jio_transaction_commit, 0);
     rb_define_method(rb_cJioTransaction, "rollback", rb_jio_transaction_rollback, 0);
     rb_define_method(rb_cJioTransaction, "release", rb_jio_transaction_release, 0);
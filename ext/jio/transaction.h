@@ -5,8 +5,11 @@
 
 typedef struct {
     jtrans_t *trans;
+    VALUE file;
     VALUE views;
     int flags;
+    struct jio_multi_op *streams;
+    struct jio_multi_op *streams_last;
 } jio_jtrans_wrapper;
 
 #define JioAssertTransaction(obj) JioAssertType(obj, rb_cJioTransaction, "JIO::Transaction")
@@ -9,4 +9,10 @@ end
 module JIO
 end
 
-require 'jio/file'
\ No newline at end of file
+require 'jio/file'
+require 'jio/multi_transaction'
+require 'jio/log'
+require 'jio/buffered_writer'
+require 'jio/page_file'
+require 'jio/hash'
+require 'jio/sharded_log'
\ No newline at end of file
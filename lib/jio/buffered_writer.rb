@@ -0,0 +1,171 @@
+# encoding: utf-8
+
+require 'thread'
+
+module JIO
+  # Write-behind batching for a JIO::File. Writes accumulate in memory and are flushed as a single
+  # transaction once a byte or record count threshold is reached, when the oldest pending write is
+  # older than the delay bound, or on an explicit flush. Contiguous writes are merged into a single
+  # transaction operation.
+  #
+  #   writer = JIO::BufferedWriter.new(file, :max_bytes => 1024 * 1024, :max_delay => 0.01)
+  #   writer.write("record\n")
+  #   writer.pwrite("header", 0)
+  #   writer.flush_and_wait
+  #
+  # With the default transaction flags every flush is durable once it returns. With JIO::J_LINGER,
+  # flush_and_wait also syncs lingering transactions to disk. Writes stay buffered if their flush
+  # fails, so it can be retried. Errors from a deadline triggered flush are raised from the next call
+  # into the writer.
+  class BufferedWriter
+    MAX_BYTES = 1024 * 1024
+    MAX_RECORDS = 1024
+    MAX_DELAY = 0.01
+
+    attr_reader :file, :pos, :max_bytes, :max_records, :max_delay
+
+    def initialize(file, options = {})
+      @file = file
+      @max_bytes = options[:max_bytes] || MAX_BYTES
+      @max_records = options[:max_records] || MAX_RECORDS
+      @max_delay = options.has_key?(:max_delay) ? options[:max_delay] : MAX_DELAY
+      @flags = options[:flags] || 0
+      @pos = file.tell
+      @ops, @bytes, @records = [], 0, 0
+      @deadline = @error = @flusher = nil
+      @closed = false
+      @mutex, @cond = Mutex.new, ConditionVariable.new
+    end
+
+    # Buffers data at the writer's position, which starts at the file handle's and is advanced
+    # independently of it. The offset is reserved under the mutex, so concurrent writes never share
+    # one. Returns the number of bytes buffered.
+    def write(data)
+      data = data.to_s
+      @mutex.synchronize do
+        check_error
+        offset = @pos
+        @pos += bytesize(data)
+        buffer(data, offset)
+      end
+    end
+
+    # Buffers data at a given offset. Returns the number of bytes buffered.
+    def pwrite(data, offset)
+      data = data.to_s
+      @mutex.synchronize{ buffer(data, offset) }
+    end
+
+    # Commits all pending writes in a single transaction.
+    def flush
+      @mutex.synchronize do
+        check_error
+        flush_buffer
+      end
+      self
+    end
+
+    # Commits all pending writes and returns once they're on disk.
+    def flush_and_wait
+      flush
+      @file.sync if @flags & JIO::J_LINGER != 0
+      self
+    end
+
+    def pending_bytes
+      @bytes
+    end
+
+    def pending_records
+      @records
+    end
+
+    # Flushes pending writes and stops the deadline thread. The file handle is left open.
+    def close
+      flush_and_wait
+    ensure
+      flusher = @mutex.synchronize do
+        @closed = true
+        @cond.signal
+        @flusher
+      end
+      flusher.join if flusher && flusher != Thread.current
+      @flusher = nil
+    end
+
+    private
+    # Appends to the pending writes and flushes past a threshold, or arms the deadline. Called with
+    # the mutex held.
+    def buffer(data, offset)
+      check_error
+      len = bytesize(data)
+      last = @ops.last
+      if last && last[0] + last[2] == offset
+        last[1] << binary(data)
+        last[2] += len
+      else
+        @ops << [offset, binary(data), len]
+      end
+      @bytes += len
+      @records += 1
+      if @bytes >= @max_bytes || @records >= @max_records
+        flush_buffer
+      elsif @max_delay && !@deadline
+        @deadline = Time.now + @max_delay
+        start_flusher
+        @cond.signal
+      end
+      len
+    end
+
+    # Pending writes are only dropped once committed. Called with the mutex held.
+    def flush_buffer
+      return if @ops.empty?
+      @file.transaction(@flags) do |trans|
+        @ops.each{|offset, data, len| trans.write(data, offset) }
+      end
+      @ops, @bytes, @records, @deadline = [], 0, 0, nil
+    end
+
+    def bytesize(str)
+      str.respond_to?(:bytesize) ? str.bytesize : str.size
+    end
+
+    def binary(str)
+      str.respond_to?(:force_encoding) ? str.dup.force_encoding('BINARY') : str.dup
+    end
+
+    def check_error
+      return unless @error
+      error, @error = @error, nil
+      raise error
+    end
+
+    # The deadline thread sleeps until the oldest pending write is due and waits on the condition
+    # variable while nothing is buffered, so an idle writer has no wakeups. It exits on close.
+    # Called with the mutex held.
+    def start_flusher
+      return if @flusher && @flusher.alive?
+      @closed = false
+      @flusher = Thread.new do
+        loop do
+          deadline = @mutex.synchronize do
+            @cond.wait(@mutex) until @closed || @deadline
+            @deadline unless @closed
+          end
+          break unless deadline
+          wait = deadline - Time.now
+          sleep(wait) if wait > 0
+          @mutex.synchronize do
+            begin
+              flush_buffer if @deadline && Time.now >= @deadline
+            rescue Exception => e
+              # the writes stay buffered, the next write arms a new deadline
+              @error, @deadline = e, nil
+            end
+          end
+        end
+      end
+    end
+  end
+end
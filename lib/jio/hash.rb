@@ -0,0 +1,237 @@
+# encoding: utf-8
+
+module JIO
+  # A persistent hash table of string keys and values, stored in a JIO::PageFile. It uses linear
+  # hashing: whenever the average number of entries per bucket exceeds the bucket load, the next
+  # bucket in turn is split in two, so the table grows one bucket at a time instead of rehashing
+  # everything. Each bucket is a chain of pages, and every update is committed as a single
+  # transaction covering all the pages it touched. Lookups are served from the page cache.
+  #
+  #   index = JIO::Hash.new("/path/offsets")
+  #   index["order-42"] = [1024].pack('N')
+  #   index["order-42"] # => "\000\000\004\000"
+  #
+  # Page 1 holds the table's metadata. Bucket page numbers are kept in a chain of directory pages.
+  class Hash
+    include Enumerable
+
+    MAGIC = "JIOH"
+    VERSION = 1
+    META_PAGE = 1
+    PAGE_SIZE = 4096
+    BUCKETS = 4
+    BUCKET_LOAD = 16
+    # next page (u64) and entry count (u32) in bucket and directory pages
+    PAGE_HEADER = 12
+    # key and value lengths are stored as u16
+    MAX_LENGTH = 65535
+    MAX_PAGE_SIZE = 65536
+
+    attr_reader :size, :bucket_load
+
+    def initialize(path, options = {})
+      if options[:page_size] && options[:page_size] > MAX_PAGE_SIZE
+        raise ArgumentError, "page size can't exceed #{MAX_PAGE_SIZE} bytes"
+      end
+      @pages = JIO::PageFile.new(path, :page_size => options[:page_size] || PAGE_SIZE, :flags => options[:flags],
+                                 :mode => options[:mode], :cache_pages => options[:cache_pages])
+      @page_size = @pages.page_size
+      @bucket_load = options[:bucket_load] || BUCKET_LOAD
+      @dir_pages, @buckets = [], []
+      if @pages.page_count == 1
+        @pages.allocate
+        @initial, @level, @split, @size = options[:buckets] || BUCKETS, 0, 0, 0
+        @initial.times{ add_bucket }
+        write_meta
+        @pages.commit
+      else
+        read_meta
+      end
+    end
+
+    def [](key)
+      key = binary(key.to_s)
+      pair = read_bucket(bucket_for(key)).assoc(key)
+      pair && pair[1]
+    end
+
+    def []=(key, value)
+      key, value = binary(key.to_s), binary(value.to_s)
+      if bytesize(key) > MAX_LENGTH || bytesize(value) > MAX_LENGTH
+        raise ArgumentError, "keys and values can't exceed #{MAX_LENGTH} bytes"
+      end
+      if PAGE_HEADER + 4 + bytesize(key) + bytesize(value) > @page_size
+        raise ArgumentError, "entry doesn't fit in a #{@page_size} byte page"
+      end
+      bucket = bucket_for(key)
+      entries = read_bucket(bucket)
+      if pair = entries.assoc(key)
+        pair[1] = value
+      else
+        entries << [key, value]
+        @size += 1
+      end
+      write_bucket(bucket, entries)
+      split if @size > @buckets.size * @bucket_load
+      write_meta
+      @pages.commit
+      value
+    end
+
+    # Removes a key, returning its value or nil if it wasn't present.
+    def delete(key)
+      key = binary(key.to_s)
+      bucket = bucket_for(key)
+      entries = read_bucket(bucket)
+      return nil unless pair = entries.assoc(key)
+      entries.delete(pair)
+      @size -= 1
+      write_bucket(bucket, entries)
+      write_meta
+      @pages.commit
+      pair[1]
+    end
+
+    def key?(key)
+      !self[key].nil?
+    end
+    alias include? key?
+
+    def each
+      return enum_for(:each) unless block_given?
+      @buckets.size.times{|bucket| read_bucket(bucket).each{|key, value| yield key, value } }
+      self
+    end
+
+    def keys
+      map{|key, value| key }
+    end
+
+    def buckets
+      @buckets.size
+    end
+
+    def sync
+      @pages.sync
+    end
+
+    def close
+      @pages.close
+    end
+
+    private
+    def bucket_for(key)
+      h = JIO.crc32c(key)
+      bucket = h % (@initial << @level)
+      bucket < @split ? h % (@initial << (@level + 1)) : bucket
+    end
+
+    # Splits the bucket at the split pointer, moving entries that hash to the next level into a
+    # new bucket at the end of the table.
+    def split
+      add_bucket
+      entries = read_bucket(@split)
+      moved = entries.select{|key, value| JIO.crc32c(key) % (@initial << (@level + 1)) != @split }
+      write_bucket(@split, entries - moved)
+      write_bucket(@buckets.size - 1, moved)
+      @split += 1
+      if @split == @initial << @level
+        @level += 1
+        @split = 0
+      end
+    end
+
+    def read_bucket(bucket)
+      entries, page = [], @buckets[bucket]
+      while page != 0
+        data = @pages.read(page)
+        page, count = u64(data, 0), data[8, 4].unpack('N')[0]
+        pos = PAGE_HEADER
+        count.times do
+          klen, vlen = data[pos, 4].unpack('nn')
+          entries << [data[pos + 4, klen], data[pos + 4 + klen, vlen]]
+          pos += 4 + klen + vlen
+        end
+      end
+      entries
+    end
+
+    # Lays entries out over the bucket's page chain, growing it or freeing unused overflow pages.
+    def write_bucket(bucket, entries)
+      page, chunks, chunk, used = @buckets[bucket], [], [], PAGE_HEADER
+      entries.each do |key, value|
+        len = 4 + bytesize(key) + bytesize(value)
+        if used + len > @page_size
+          chunks << chunk
+          chunk, used = [], PAGE_HEADER
+        end
+        chunk << [bytesize(key), bytesize(value)].pack('nn') + key + value
+        used += len
+      end
+      chunks << chunk
+      next_page = u64(@pages.read(page, 0, 8), 0)
+      chunks.each_with_index do |entries_data, i|
+        if i == chunks.size - 1
+          while next_page != 0
+            free, next_page = next_page, u64(@pages.read(next_page, 0, 8), 0)
+            @pages.free(free)
+          end
+        elsif next_page == 0
+          next_page = @pages.allocate
+        end
+        @pages.write(page, pack_u64(next_page) + [entries_data.size].pack('N') + entries_data.join)
+        page = next_page
+        next_page = u64(@pages.read(page, 0, 8), 0) if page != 0
+      end
+    end
+
+    def add_bucket
+      per_page = (@page_size - PAGE_HEADER) / 8
+      index = @buckets.size
+      if index % per_page == 0
+        page = @pages.allocate
+        @pages.write(@dir_pages.last, pack_u64(page)) unless @dir_pages.empty?
+        @dir_pages << page
+      end
+      @buckets << @pages.allocate
+      dir = @dir_pages[index / per_page]
+      @pages.write(dir, [index % per_page + 1].pack('N'), 8)
+      @pages.write(dir, pack_u64(@buckets.last), PAGE_HEADER + (index % per_page) * 8)
+    end
+
+    def write_meta
+      @pages.write(META_PAGE, [MAGIC, VERSION, @initial, @level].pack('a4NNN') + pack_u64(@split) +
+                   pack_u64(@size) + pack_u64(@dir_pages.first))
+    end
+
+    def read_meta
+      meta = @pages.read(META_PAGE, 0, 40)
+      magic, version, @initial, @level = meta.unpack('a4NNN')
+      raise ArgumentError, "not a JIO::Hash" unless magic == MAGIC && version == VERSION
+      @split, @size, page = u64(meta, 16), u64(meta, 24), u64(meta, 32)
+      while page != 0
+        data = @pages.read(page)
+        @dir_pages << page
+        data[8, 4].unpack('N')[0].times{|i| @buckets << u64(data, PAGE_HEADER + i * 8) }
+        page = u64(data, 0)
+      end
+    end
+
+    def u64(str, pos)
+      hi, lo = str[pos, 8].unpack('NN')
+      (hi << 32) | lo
+    end
+
+    def pack_u64(n)
+      [n >> 32, n & 0xffffffff].pack('NN')
+    end
+
+    def bytesize(str)
+      str.respond_to?(:bytesize) ? str.bytesize : str.size
+    end
+
+    def binary(str)
+      str.respond_to?(:force_encoding) ? str.dup.force_encoding('BINARY') : str
+    end
+  end
+end
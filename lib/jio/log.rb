@@ -0,0 +1,277 @@
+# encoding: utf-8
+
+require 'fileutils'
+
+module JIO
+  # A framed, checksummed append-only record log. Each record is stored as a 16 byte header (payload
+  # length, 64 bit sequence number and a CRC32c of both plus the payload) followed by the payload.
+  # A batch of records is written with a single transaction per segment, and the log rolls into a new
+  # segment file, named after its first sequence number, once the segment size is reached.
+  #
+  #   log = JIO::Log.new("/path/events", :segment_size => 64 * 1024 * 1024)
+  #   log.append(%w(a b c)) # => 3
+  #   log.each_from(2){|seq, record| }
+  #
+  # Each segment has a companion sparse index of (sequence number, offset) entries for every Nth
+  # record, written in the same multi file transaction as the records it points to. seek_to_seq
+  # binary searches its memory mapped entries and scans forward from there. Missing or stale entries
+  # are rebuilt incrementally from the segment.
+  #
+  # With :journal_dir, the journals of the files being written are moved into that directory, which
+  # may live on a different device.
+  #
+  # A log directory supports a single writer. Opening a log replays its tail segment's journal and
+  # truncates any torn or corrupt records at the end of it.
+  class Log
+    HEADER_SIZE = 16
+    SEGMENT_SIZE = 64 * 1024 * 1024
+    INDEX_INTERVAL = 1024
+    READ_SIZE = 64 * 1024
+    SEGMENT_FORMAT = "%020d.log"
+    INDEX_FORMAT = "%020d.idx"
+
+    attr_reader :path, :segment_size, :index_interval, :next_seq
+
+    def initialize(path, options = {})
+      @path = path
+      @segment_size = options[:segment_size] || SEGMENT_SIZE
+      @index_interval = options[:index_interval] || INDEX_INTERVAL
+      @flags = options[:flags] || 0
+      @mode = options[:mode] || 0644
+      @journal_dir = options[:journal_dir]
+      FileUtils.mkdir_p(path)
+      FileUtils.mkdir_p(@journal_dir) if @journal_dir
+      @segments = Dir[::File.join(path, '*.log')].map{|f| ::File.basename(f).to_i }.sort
+      @segments << 1 if @segments.empty?
+      recover
+    end
+
+    # Appends one or more records in as few transactions as possible, one per segment written to.
+    # Returns the sequence number of the last record.
+    def append(*records)
+      frames, entries, offset = [], [], @tail_offset
+      records.flatten.each do |record|
+        record = binary(record.to_s)
+        size = HEADER_SIZE + bytesize(record)
+        if offset > 0 && offset + size > @segment_size
+          commit(frames, entries) unless frames.empty?
+          roll
+          frames, entries, offset = [], [], 0
+        end
+        seq = @next_seq + frames.size
+        entries << index_entry(seq, offset) if indexed?(@segments.last, seq)
+        frames << frame(seq, record)
+        offset += size
+      end
+      commit(frames, entries) unless frames.empty?
+      last_seq
+    end
+
+    # Yields each record, along with its sequence number, starting at the given sequence number.
+    def each_from(seq = first_seq)
+      return enum_for(:each_from, seq) unless block_given?
+      start = segment_index(seq)
+      (start...@segments.size).each do |i|
+        with_segment(i) do |file, index, first, limit|
+          from, offset = i == start ? seek(file, index, first, seq, limit) : [first, 0]
+          each_frame(file, from, offset, limit){|s, record, off| yield s, record }
+        end
+      end
+      self
+    end
+
+    # Returns the segment path and offset of the record with the given sequence number, or nil if
+    # there's no such record.
+    def seek_to_seq(seq)
+      return nil if seq < first_seq || seq > last_seq
+      i = segment_index(seq)
+      with_segment(i) do |file, index, first, limit|
+        from, offset = seek(file, index, first, seq, limit)
+        from == seq ? [segment_path(first), offset] : nil
+      end
+    end
+
+    def first_seq
+      @segments.first
+    end
+
+    def last_seq
+      @next_seq - 1
+    end
+
+    def segments
+      @segments.map{|first| segment_path(first) }
+    end
+
+    def sync
+      @file.sync
+    end
+
+    def close
+      @index.file.close
+      @file.close
+    end
+
+    private
+    def recover
+      first = @segments.last
+      tail = segment_path(first)
+      [tail, index_path(first)].each do |file|
+        JIO.check(file, 0, journal_path(file)) if ::File.exist?(file) && ::File.directory?(journal_path(file))
+      end
+      @file = open_file(tail, JIO::RDWR | JIO::CREAT)
+      @index = JIO::Index.new(open_file(index_path(first), JIO::RDWR | JIO::CREAT))
+      size = ::File.size(tail)
+      @tail_offset, @next_seq = reindex(@file, @index, first, size)
+      @file.truncate(@tail_offset) if @tail_offset < size
+    end
+
+    def commit(frames, entries)
+      data = frames.join
+      if entries.empty?
+        @file.transaction(@flags){|trans| trans.write(data, @tail_offset) }
+      else
+        JIO.transaction(@file, @index.file) do |trans|
+          trans.write(@file, data, @tail_offset)
+          trans.write(@index.file, entries.join, @index.size * JIO::Index::ENTRY_SIZE)
+        end
+      end
+      @tail_offset += bytesize(data)
+      @next_seq += frames.size
+    end
+
+    def roll
+      close
+      @segments << @next_seq
+      @file = open_file(segment_path(@next_seq), JIO::RDWR | JIO::CREAT | JIO::TRUNC)
+      @index = JIO::Index.new(open_file(index_path(@next_seq), JIO::RDWR | JIO::CREAT | JIO::TRUNC))
+      @tail_offset = 0
+    end
+
+    # Validates a segment's index against its data, dropping entries past the last valid record and
+    # appending missing ones from the last valid entry onwards. Returns the end offset and next
+    # sequence number of the segment.
+    def reindex(file, index, first, limit)
+      from, offset = first, 0
+      while entry = index[-1]
+        valid = false
+        each_frame(file, entry[0], entry[1], limit){|s, record, off| valid = true; break }
+        if valid
+          from, offset = entry
+          break
+        end
+        index.file.truncate((index.size - 1) * JIO::Index::ENTRY_SIZE)
+      end
+      entries, next_seq = [], from
+      entries << [from, offset] if index.size == 0
+      each_frame(file, from, offset, limit) do |s, record, off|
+        entries << [s + 1, off] if indexed?(first, s + 1)
+        offset, next_seq = off, s + 1
+      end
+      entries.pop if entries.last && entries.last[0] == next_seq
+      index.file.pwrite(entries.map{|e| index_entry(*e) }.join, index.size * JIO::Index::ENTRY_SIZE) unless entries.empty?
+      [offset, next_seq]
+    end
+
+    # Returns the sequence number and offset to start scanning at for the given sequence number, using
+    # the index entry at or before it.
+    def seek(file, index, first, seq, limit)
+      from, offset = index.lookup(seq) || [first, 0]
+      each_frame(file, from, offset, limit) do |s, record, off|
+        break if s >= seq
+        from, offset = s + 1, off
+      end
+      [from, offset]
+    end
+
+    def indexed?(first, seq)
+      (seq - first) % @index_interval == 0
+    end
+
+    def index_entry(seq, offset)
+      [seq >> 32, seq & 0xffffffff, offset >> 32, offset & 0xffffffff].pack('NNNN')
+    end
+
+    def frame(seq, record)
+      header = [bytesize(record), seq >> 32, seq & 0xffffffff].pack('NNN')
+      header << [JIO.crc32c(record, JIO.crc32c(header))].pack('N') << record
+    end
+
+    # Yields sequence number, record and end offset for each valid frame in a segment from the given
+    # position, stopping at the first torn or corrupt one.
+    def each_frame(file, seq, offset, limit)
+      buf, pos = nil, 0
+      while offset + HEADER_SIZE <= limit
+        buf, pos = fill(file, buf, pos, offset, offset + HEADER_SIZE, limit)
+        header = buf[offset - pos, HEADER_SIZE]
+        len, hi, lo, crc = header.unpack('NNNN')
+        break if ((hi << 32) | lo) != seq || offset + HEADER_SIZE + len > limit
+        buf, pos = fill(file, buf, pos, offset, offset + HEADER_SIZE + len, limit)
+        record = buf[offset - pos + HEADER_SIZE, len]
+        break if JIO.crc32c(record, JIO.crc32c(header[0, 12])) != crc
+        offset += HEADER_SIZE + len
+        yield seq, record, offset
+        seq += 1
+      end
+    end
+
+    # Makes sure the read buffer covers the given range, discarding everything before from
+    def fill(file, buf, pos, from, upto, limit)
+      return [buf, pos] if buf && pos + bytesize(buf) >= upto
+      buf = buf ? buf[(from - pos)..-1] : file.pread(0, from)
+      pos = from
+      want = upto - pos - bytesize(buf)
+      want = READ_SIZE if want < READ_SIZE
+      want = limit - pos - bytesize(buf) if pos + bytesize(buf) + want > limit
+      buf << file.pread(want, pos + bytesize(buf))
+      [buf, pos]
+    end
+
+    def with_segment(i)
+      first = @segments[i]
+      return yield(@file, @index, first, @tail_offset) if i == @segments.size - 1
+      file = JIO.open(segment_path(first), JIO::RDONLY, 0, 0)
+      index = JIO::Index.new(open_file(index_path(first), JIO::RDWR | JIO::CREAT))
+      begin
+        limit = ::File.size(segment_path(first))
+        reindex(file, index, first, limit)
+        yield file, index, first, limit
+      ensure
+        index.file.close
+        file.close
+      end
+    end
+
+    def segment_index(seq)
+      i = @segments.size - 1
+      i -= 1 while i > 0 && @segments[i] > seq
+      i
+    end
+
+    def segment_path(first)
+      ::File.join(@path, SEGMENT_FORMAT % first)
+    end
+
+    def index_path(first)
+      ::File.join(@path, INDEX_FORMAT % first)
+    end
+
+    def open_file(path, flags)
+      file = JIO.open(path, flags, @mode, @flags)
+      file.move_journal(journal_path(path)) if @journal_dir
+      file
+    end
+
+    def journal_path(file)
+      ::File.join(@journal_dir || ::File.dirname(file), ".#{::File.basename(file)}.jio")
+    end
+
+    def bytesize(str)
+      str.respond_to?(:bytesize) ? str.bytesize : str.size
+    end
+
+    def binary(str)
+      str.respond_to?(:force_encoding) ? str.dup.force_encoding('BINARY') : str
+    end
+  end
+end
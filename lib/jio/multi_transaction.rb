@@ -0,0 +1,20 @@
+# encoding: utf-8
+
+module JIO
+  class << self
+    alias orig_transaction transaction
+    def transaction(*files)
+      if block_given?
+        begin
+          trans = orig_transaction(*files)
+          yield trans
+          trans.commit unless trans.committed?
+        ensure
+          trans.release if trans
+        end
+      else
+        orig_transaction(*files)
+      end
+    end
+  end
+end
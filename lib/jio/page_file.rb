@@ -0,0 +1,276 @@
+# encoding: utf-8
+
+require 'thread'
+
+module JIO
+  # A file of fixed size pages with an in-process page cache. Page 0 holds a header (magic, page
+  # size, page count and the head of the free page list); freed pages are chained through their
+  # first 8 bytes. Pages are cached in shards, each evicting with the CLOCK algorithm, and pinned or
+  # dirty pages are never evicted. Changes stay in the cache until commit, which writes every dirty
+  # page in a single transaction, with runs of adjacent pages merged into single operations.
+  #
+  #   pages = JIO::PageFile.new("/path/pages", :page_size => 4096, :cache_pages => 1024)
+  #   n = pages.allocate
+  #   pages.write(n, "data")
+  #   pages.commit
+  #   pages.read(n, 0, 4) # => "data"
+  #
+  # A page file supports a single writer. Opening it replays its journal.
+  class PageFile
+    MAGIC = "JIOP"
+    VERSION = 1
+    HEADER_SIZE = 28
+    PAGE_SIZE = 4096
+    CACHE_PAGES = 1024
+    SHARDS = 8
+
+    # A CLOCK cache shard. Entries are [page, data, referenced, pins, dirty].
+    class Shard
+      attr_reader :mutex
+
+      def initialize(capacity)
+        @capacity, @entries, @ring, @hand, @mutex = capacity, {}, [], 0, Mutex.new
+      end
+
+      def [](page)
+        entry = @entries[page]
+        entry[2] = true if entry
+        entry
+      end
+
+      def add(page, data)
+        evict while @entries.size >= @capacity && evictable?
+        entry = [page, data, true, 0, false]
+        @entries[page] = entry
+        @ring << entry
+        entry
+      end
+
+      def delete(page)
+        entry = @entries.delete(page)
+        @ring.delete(entry) if entry
+      end
+
+      def dirty
+        @entries.values.select{|entry| entry[4] }
+      end
+
+      private
+      def evictable?
+        @ring.any?{|entry| entry[3] == 0 && !entry[4] }
+      end
+
+      def evict
+        loop do
+          @hand = 0 if @hand >= @ring.size
+          entry = @ring[@hand]
+          if entry[3] > 0 || entry[4]
+            @hand += 1
+          elsif entry[2]
+            entry[2] = false
+            @hand += 1
+          else
+            @ring.delete_at(@hand)
+            @entries.delete(entry[0])
+            return
+          end
+        end
+      end
+    end
+
+    attr_reader :path, :page_size, :page_count
+
+    def initialize(path, options = {})
+      @path = path
+      @page_size = options[:page_size] || PAGE_SIZE
+      @flags = options[:flags] || 0
+      shards = options[:shards] || SHARDS
+      capacity = (options[:cache_pages] || CACHE_PAGES) / shards
+      @shards = Array.new(shards){ Shard.new(capacity < 1 ? 1 : capacity) }
+      raise ArgumentError, "page size must be at least #{HEADER_SIZE} bytes" if @page_size < HEADER_SIZE
+      JIO.check(path, 0) if ::File.exist?(path) && ::File.directory?(journal_path)
+      @file = JIO.open(path, JIO::RDWR | JIO::CREAT, options[:mode] || 0644, @flags)
+      if ::File.size(path) == 0
+        @page_count, @free_head = 1, 0
+        entry(0, binary("\0" * @page_size))[4] = true
+        write_header
+        commit
+      else
+        read_header
+      end
+      pin(0)
+    end
+
+    # Returns a page number for a new, zero filled page, reusing freed pages first.
+    def allocate
+      if @free_head == 0
+        page = @page_count
+        @page_count += 1
+        entry(page, binary("\0" * @page_size))[4] = true
+      else
+        page = @free_head
+        @free_head = unpack_u64(read(page, 0, 8))
+        write(page, "\0" * @page_size)
+      end
+      write_header
+      page
+    end
+
+    # Returns a page to the free list.
+    def free(page)
+      check_page(page)
+      raise ArgumentError, "can't free the header page" if page == 0
+      write(page, pack_u64(@free_head))
+      @free_head = page
+      write_header
+      nil
+    end
+
+    # Returns a copy of a page, or of a range within it.
+    def read(page, offset = 0, length = @page_size - offset)
+      data = fetch(page)[1]
+      data[offset, length]
+    end
+
+    # Overwrites part of a page in the cache, marking it dirty.
+    def write(page, data, offset = 0)
+      data = binary(data.to_s)
+      raise ArgumentError, "write past end of page" if offset + bytesize(data) > @page_size
+      entry = fetch(page)
+      entry[1][offset, bytesize(data)] = data
+      entry[4] = true
+      bytesize(data)
+    end
+
+    # Keeps a page in the cache until unpinned. Pins are counted.
+    def pin(page)
+      fetch(page){|entry| entry[3] += 1 }
+      if block_given?
+        begin
+          yield page
+        ensure
+          unpin(page)
+        end
+      else
+        page
+      end
+    end
+
+    def unpin(page)
+      entry = shard(page).mutex.synchronize{ shard(page)[page] }
+      raise ArgumentError, "page #{page} isn't pinned" unless entry && entry[3] > 0
+      shard(page).mutex.synchronize{ entry[3] -= 1 }
+      nil
+    end
+
+    def pinned?(page)
+      entry = shard(page).mutex.synchronize{ shard(page)[page] }
+      !!(entry && entry[3] > 0)
+    end
+
+    def dirty_pages
+      @shards.map{|s| s.mutex.synchronize{ s.dirty.map{|entry| entry[0] } } }.flatten.sort
+    end
+
+    # Writes all dirty pages in a single transaction. Returns the number of pages written.
+    def commit
+      dirty = @shards.map{|s| s.mutex.synchronize{ s.dirty } }.flatten(1).sort_by{|entry| entry[0] }
+      return 0 if dirty.empty?
+      runs = []
+      dirty.each do |entry|
+        if runs.last && runs.last[0] + runs.last[1].size == entry[0]
+          runs.last[1] << entry
+        else
+          runs << [entry[0], [entry]]
+        end
+      end
+      @file.transaction(@flags) do |trans|
+        runs.each{|first, entries| trans.write(entries.map{|entry| entry[1] }.join, first * @page_size) }
+      end
+      dirty.each{|entry| entry[4] = false }
+      dirty.size
+    end
+
+    # Drops all uncommitted changes. Pinned pages, the header included, stay cached along with their
+    # pin counts and are reloaded from disk instead.
+    def rollback
+      @shards.each do |s|
+        s.mutex.synchronize do
+          s.dirty.each do |entry|
+            next s.delete(entry[0]) if entry[3] == 0
+            data = binary(@file.pread(@page_size, entry[0] * @page_size))
+            entry[1] = data + "\0" * (@page_size - bytesize(data))
+            entry[4] = false
+          end
+        end
+      end
+      read_header
+    end
+
+    def sync
+      @file.sync
+    end
+
+    def close
+      @file.close
+    end
+
+    private
+    def fetch(page)
+      check_page(page)
+      s = shard(page)
+      s.mutex.synchronize do
+        entry = s[page] || s.add(page, binary(@file.pread(@page_size, page * @page_size)))
+        yield entry if block_given?
+        entry
+      end
+    end
+
+    def entry(page, data)
+      s = shard(page)
+      s.mutex.synchronize{ s.delete(page); s.add(page, data) }
+    end
+
+    def shard(page)
+      @shards[page % @shards.size]
+    end
+
+    def check_page(page)
+      raise IndexError, "page #{page} out of range" if page < 0 || page >= @page_count
+    end
+
+    def read_header
+      header = @file.pread(HEADER_SIZE, 0)
+      magic, version, page_size = header.unpack('a4NN')
+      raise ArgumentError, "#{@path} is not a page file" unless magic == MAGIC && version == VERSION
+      raise ArgumentError, "#{@path} has #{page_size} byte pages" unless page_size == @page_size
+      @page_count = unpack_u64(header[12, 8])
+      @free_head = unpack_u64(header[20, 8])
+    end
+
+    def write_header
+      write(0, [MAGIC, VERSION, @page_size].pack('a4NN') + pack_u64(@page_count) + pack_u64(@free_head))
+    end
+
+    def pack_u64(n)
+      [n >> 32, n & 0xffffffff].pack('NN')
+    end
+
+    def unpack_u64(str)
+      hi, lo = str.unpack('NN')
+      (hi << 32) | lo
+    end
+
+    def journal_path
+      ::File.join(::File.dirname(@path), ".#{::File.basename(@path)}.jio")
+    end
+
+    def bytesize(str)
+      str.respond_to?(:bytesize) ? str.bytesize : str.size
+    end
+
+    def binary(str)
+      str.respond_to?(:force_encoding) ? str.dup.force_encoding('BINARY') : str.dup
+    end
+  end
+end
@@ -0,0 +1,123 @@
+# encoding: utf-8
+
+require 'thread'
+
+module JIO
+  # A record log spread over a number of JIO::Log shards, each with its own files, journals and
+  # sequence numbers, so that commits to different shards don't contend on a single journal
+  # directory, lock file or fsync queue. Appends are routed by a hash of their key, or round-robin
+  # without one. Each shard's journals can be moved to their own directory, possibly on a different
+  # device, with :journal_dirs.
+  #
+  #   log = JIO::ShardedLog.new("/path/events", :shards => 4, :journal_dirs => %w(/nvme0 /nvme1))
+  #   log.append("event", "aggregate-42") # => [shard, seq]
+  #   log.each{|shard, seq, record| }
+  #
+  # Every record is prefixed with an 8 byte stamp from a counter shared by all shards and taken
+  # under the shard's lock, so stamps grow monotonically within a shard and each merges the
+  # shards back into a single order.
+  class ShardedLog
+    SHARDS = 4
+    SHARD_FORMAT = "shard-%03d"
+    STAMP_SIZE = 8
+
+    attr_reader :path, :shards
+
+    def initialize(path, options = {})
+      @path = path
+      existing = Dir[::File.join(path, 'shard-*')].size
+      @count = existing > 0 ? existing : (options[:shards] || SHARDS)
+      journal_dirs = options[:journal_dirs]
+      @shards = (0...@count).map do |i|
+        name = SHARD_FORMAT % i
+        opts = options.merge(:journal_dir => journal_dirs && ::File.join(journal_dirs[i % journal_dirs.size], name))
+        JIO::Log.new(::File.join(path, name), opts)
+      end
+      @locks = @shards.map{ Mutex.new }
+      @mutex = Mutex.new
+      @next = 0
+      @stamp = @shards.map{|log| last_stamp(log) }.max + 1
+    end
+
+    # Returns the shard a key routes to.
+    def shard_for(key)
+      JIO.crc32c(key.to_s) % @count
+    end
+
+    # Appends one or more records to a single shard, chosen by key or round-robin. Returns the shard
+    # and the sequence number of the last record within it.
+    def append(records, key = nil)
+      shard = key.nil? ? @mutex.synchronize{ (@next += 1) % @count } : shard_for(key)
+      records = [records].flatten
+      @locks[shard].synchronize do
+        stamps = @mutex.synchronize{ s = @stamp; @stamp += records.size; s }
+        framed = records.each_with_index.map{|record, i| stamp(stamps + i) << binary(record.to_s) }
+        [shard, @shards[shard].append(framed)]
+      end
+    end
+
+    # Yields each record of a shard along with its sequence number, starting at the given one.
+    def each_in(shard, seq = 1)
+      return enum_for(:each_in, shard, seq) unless block_given?
+      @shards[shard].each_from(seq){|s, record| yield s, record[STAMP_SIZE..-1] }
+    end
+
+    # Yields shard, sequence number and record for every record across shards in stamp order,
+    # starting at the given per shard sequence numbers.
+    def each(from = {})
+      return enum_for(:each, from) unless block_given?
+      heads = (0...@count).map do |shard|
+        enum = @shards[shard].each_from(from[shard] || 1)
+        [shard, enum, fetch(enum)]
+      end
+      heads.reject!{|head| head[2].nil? }
+      until heads.empty?
+        head = heads.min_by{|h| h[2][0] }
+        stamp, seq, record = head[2]
+        yield head[0], seq, record
+        head[2] = fetch(head[1])
+        heads.delete(head) if head[2].nil?
+      end
+      self
+    end
+
+    # Returns each shard's last sequence number.
+    def last_seqs
+      @shards.map{|log| log.last_seq }
+    end
+
+    def sync
+      @shards.each{|log| log.sync }
+    end
+
+    def close
+      @shards.each{|log| log.close }
+    end
+
+    private
+    def fetch(enum)
+      seq, record = enum.next
+      [unstamp(record), seq, record[STAMP_SIZE..-1]]
+    rescue StopIteration
+      nil
+    end
+
+    def last_stamp(log)
+      return 0 if log.last_seq == 0
+      unstamp(log.each_from(log.last_seq).first[1])
+    end
+
+    def stamp(n)
+      [n >> 32, n & 0xffffffff].pack('NN')
+    end
+
+    def binary(str)
+      str.respond_to?(:force_encoding) ? str.dup.force_encoding('BINARY') : str
+    end
+
+    def unstamp(record)
+      hi, lo = record[0, STAMP_SIZE].unpack('NN')
+      (hi << 32) | lo
+    end
+  end
+end
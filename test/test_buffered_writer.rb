@@ -0,0 +1,97 @@
+# encoding: utf-8
+
+require File.join(File.dirname(__FILE__), 'helper')
+
+class TestBufferedWriter < JioTestCase
+  def test_flush
+    file = JIO.open(*OPEN_ARGS)
+    writer = JIO::BufferedWriter.new(file, :max_delay => nil)
+    assert_equal 3, writer.write('abc')
+    writer.write('def')
+    writer.pwrite('X', 10)
+    assert_equal 7, writer.pending_bytes
+    assert_equal 3, writer.pending_records
+    assert_equal 0, File.size(FILE)
+    writer.flush
+    assert_equal 0, writer.pending_bytes
+    assert_equal 'abcdef', file.pread(6, 0)
+    assert_equal 'X', file.pread(1, 10)
+  ensure
+    writer.close
+    file.close
+  end
+
+  def test_thresholds
+    file = JIO.open(*OPEN_ARGS)
+    writer = JIO::BufferedWriter.new(file, :max_records => 3, :max_bytes => 8, :max_delay => nil)
+    writer.write('a')
+    writer.write('b')
+    assert_equal 0, File.size(FILE)
+    writer.write('c')
+    assert_equal 'abc', file.pread(3, 0)
+    writer.write('12345678')
+    assert_equal 'abc12345678', file.pread(11, 0)
+  ensure
+    writer.close
+    file.close
+  end
+
+  def test_concurrent_writes
+    file = JIO.open(*OPEN_ARGS)
+    writer = JIO::BufferedWriter.new(file, :max_records => 16, :max_delay => 0.001)
+    threads = (0...8).map do |t|
+      Thread.new{ 200.times{|i| writer.write("%d:%03d\n" % [t, i]) } }
+    end
+    threads.each{|t| t.join }
+    writer.flush_and_wait
+    assert_equal 8 * 200 * 6, writer.pos
+    lines = file.pread(writer.pos, 0).split("\n")
+    assert_equal (0...8).map{|t| (0...200).map{|i| "%d:%03d" % [t, i] } }.flatten.sort, lines.sort
+  ensure
+    writer.close
+    file.close
+  end
+
+  def test_deadline
+    file = JIO.open(*OPEN_ARGS)
+    writer = JIO::BufferedWriter.new(file, :max_delay => 0.05, :flags => JIO::J_LINGER)
+    writer.write('late')
+    assert_equal 0, File.size(FILE)
+    sleep 0.3
+    assert_equal 0, writer.pending_records
+    assert_equal 'late', file.pread(4, 0)
+    writer.write('r')
+    writer.flush_and_wait
+    assert_equal 'later', file.pread(5, 0)
+    flusher = writer.instance_variable_get(:@flusher)
+    sleep 0.1
+    assert_equal 'sleep', flusher.status
+    writer.close
+    assert !flusher.alive?
+  ensure
+    writer.close
+    file.close
+  end
+
+  def test_failed_flush_keeps_writes
+    file = JIO.open(*OPEN_ARGS)
+    def file.transaction(flags)
+      raise IOError, 'commit failed' if @fail
+      super
+    end
+    file.instance_variable_set(:@fail, true)
+    writer = JIO::BufferedWriter.new(file, :max_delay => 0.05)
+    writer.write('kept')
+    sleep 0.3
+    assert_raise(IOError){ writer.write('!') }
+    assert_raise(IOError){ writer.flush }
+    assert_equal 4, writer.pending_bytes
+    file.instance_variable_set(:@fail, false)
+    writer.flush
+    assert_equal 0, writer.pending_bytes
+    assert_equal 'kept', file.pread(4, 0)
+  ensure
+    writer.close
+    file.close
+  end
+end
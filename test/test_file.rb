@@ -51,6 +51,154 @@ class TestFile < JioTestCase
     assert file.close
   end
 
+  def test_follow
+    file = JIO.open(FILE, JIO::RDWR | JIO::CREAT | JIO::TRUNC, 0644, 0)
+    file.pwrite('head', 0)
+    reader = JIO.open(FILE, JIO::RDONLY, 0, 0)
+    followers = (1..2).map do
+      Thread.new do
+        data = ''
+        reader.follow(2){|chunk| data << chunk; break if data.size >= 10 }
+        data
+      end
+    end
+    sleep 0.1
+    file.transaction(0){|trans| trans.write('tail', 4) }
+    file.pwrite('more', 8)
+    Timeout.timeout(5) do
+      followers.each{|t| assert_equal 'adtailmore', t.value }
+    end
+    assert_equal ['adtailmore'], reader.follow(2).first(1)
+  ensure
+    reader.close
+    file.close
+  end
+
+  def test_follow_wakes_every_follower
+    file = JIO.open(FILE, JIO::RDWR | JIO::CREAT | JIO::TRUNC, 0644, 0)
+    reader = JIO.open(FILE, JIO::RDONLY, 0, 0)
+    records = (0...200).map{|i| "%04d" % i }
+    followers = (1..4).map do
+      Thread.new do
+        data = ''
+        reader.follow(0){|chunk| data << chunk; break if data.size >= records.join.size }
+        data
+      end
+    end
+    sleep 0.1
+    # each write is followed by a pause, so a follower missing one is left waiting on the next
+    records.each_with_index{|record, i| file.pwrite(record, i * 4); sleep 0.001 }
+    Timeout.timeout(5) do
+      followers.each{|t| assert_equal records.join, t.value }
+    end
+  ensure
+    reader.close
+    file.close
+  end
+
+  def test_follow_skips_transactions_being_applied
+    file = JIO.open(*OPEN_ARGS)
+    records = (0...20).map{|i| "H%07d" % i + 'b' * 4088 }
+    pid = fork do
+      writer = JIO.open(FILE, JIO::RDWR, 0, 0)
+      records.each_with_index do |record, i|
+        # the body extends the file before the header at a lower offset is written
+        writer.transaction(0){|t| t.write(record[8..-1], i * 4096 + 8); t.write(record[0, 8], i * 4096) }
+      end
+      exit!(0)
+    end
+    data = ''
+    Timeout.timeout(10) do
+      file.follow(0){|chunk| data << chunk; break if data.size >= records.join.size }
+    end
+    Process.wait(pid)
+    assert_equal records.join, data
+  ensure
+    file.close
+  end
+
+  def test_each_chunk
+    file = JIO.open(*OPEN_ARGS)
+    data = (0...10_000).map{|i| (i % 256).chr }.join
+    file.pwrite(data, 0)
+    chunks = []
+    assert_equal file, file.each_chunk(1024, :readahead => 3){|chunk| chunks << chunk.dup }
+    assert_equal 10, chunks.size
+    assert_equal 784, chunks.last.size
+    assert_equal data, chunks.join
+    assert_equal [data[5000, 4096]], file.each_chunk(4096, :offset => 5000).first(1)
+    file.pwrite('X', 10_239)
+    assert_equal 10, file.each_chunk(1024).to_a.size
+  ensure
+    file.close
+  end
+
+  def test_close_in_use
+    file = JIO.open(*OPEN_ARGS)
+    file.pwrite('x' * 4096, 0)
+    file.each_chunk(1024){|chunk| assert_raise(IOError){ file.close } }
+    trans = file.transaction(0)
+    trans.write('y', 0)
+    assert file.close
+    assert_raise(IOError){ file.close }
+    assert_raise(IOError){ file.pread(1, 0) }
+    assert_raise(IOError){ trans.commit }
+  ensure
+    trans.release
+  end
+
+  if defined?(Ractor)
+    def test_shareable_across_ractors
+      file = JIO.open(File.join(SANDBOX, 'ractor.jio'), JIO::RDWR | JIO::CREAT | JIO::TRUNC, 0644, 0)
+      Ractor.make_shareable(file)
+      assert Ractor.shareable?(file)
+      ractors = (0...4).map do |i|
+        Ractor.new(file, i) do |f, n|
+          f.pwrite("r#{n}", n * 2)
+          trans = f.transaction(0)
+          trans.read(2, n * 2)
+          trans.commit
+          views = trans.views
+          trans.release
+          views
+        end
+      end
+      assert_equal [['r0'], ['r1'], ['r2'], ['r3']], ractors.map{|r| r.take }.sort
+      assert_equal 'r0r1r2r3', file.pread(8, 0)
+    ensure
+      file.close
+    end
+  end
+
+  def test_direct_read_write
+    file = JIO.open(FILE, JIO::RDWR | JIO::CREAT | JIO::TRUNC | JIO::DIRECT, 0644, 0)
+    assert_equal 4, file.pwrite('ABCD', 0)
+    assert_equal 'BC', file.pread(2, 1)
+    file.pwrite('X' * 8192, 4)
+    assert_equal 'DXX', file.pread(3, 3)
+    assert_equal 'X' * 8192, file.pread(8192, 4)
+    assert_equal 'XX', file.pread(10, 8194)
+    assert_equal '', file.pread(10, 16384)
+    assert file.sync
+  ensure
+    assert file.close
+  end
+
+  def test_direct_commits_and_scans
+    file = JIO.open(FILE, JIO::RDWR | JIO::CREAT | JIO::TRUNC | JIO::DIRECT, 0644, 0)
+    file.write('head')
+    file.transaction(0){|trans| trans.write('T' * 5000, 4) }
+    JIO.transaction(file){|trans| trans.write(file, 'M' * 100, 5004) }
+    data = 'head' + 'T' * 5000 + 'M' * 100
+    assert_equal data, file.each_chunk(1000).map{|chunk| chunk.dup }.join
+    assert_equal data, JIO::Reader.new(file, 512).gets(nil)
+    file.rewind
+    assert_equal 'headT', file.read(5)
+    assert_equal 'TT', file.read(2)
+  ensure
+    file.close
+  end
+
   def test_lseek
     file = JIO.open(*OPEN_ARGS)
     assert_equal 4, file.write('ABCD')
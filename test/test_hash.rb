@@ -0,0 +1,55 @@
+# encoding: utf-8
+
+require File.join(File.dirname(__FILE__), 'helper')
+
+class TestHash < JioTestCase
+  HASH = File.join(SANDBOX, 'hash.jio')
+
+  def setup
+    super
+    File.unlink(HASH) if File.exist?(HASH)
+  end
+
+  def test_store_fetch_delete
+    hash = JIO::Hash.new(HASH)
+    assert_nil hash['missing']
+    hash['a'] = '1'
+    hash['b'] = '2'
+    hash['a'] = '3'
+    assert_equal 2, hash.size
+    assert_equal '3', hash['a']
+    assert hash.key?('b')
+    assert_equal '2', hash.delete('b')
+    assert_nil hash.delete('b')
+    assert_equal [['a', '3']], hash.to_a
+    assert_raise(ArgumentError){ hash['big'] = 'x' * 4096 }
+  ensure
+    hash.close
+  end
+
+  def test_length_limits
+    assert_raise(ArgumentError){ JIO::Hash.new(HASH, :page_size => 131072) }
+    hash = JIO::Hash.new(HASH, :page_size => 65536)
+    assert_raise(ArgumentError){ hash['k' * 65536] = '' }
+    hash['k'] = 'v' * 65000
+    assert_equal 'v' * 65000, hash['k']
+  ensure
+    hash.close if hash
+  end
+
+  def test_incremental_split_and_reopen
+    hash = JIO::Hash.new(HASH, :page_size => 64, :buckets => 2, :bucket_load => 4)
+    1.upto(200){|i| hash["key#{i}"] = "value#{i}" }
+    assert_equal 200, hash.size
+    assert_equal 50, hash.buckets
+    hash.close
+    hash = JIO::Hash.new(HASH, :page_size => 64, :bucket_load => 4)
+    assert_equal 200, hash.size
+    assert_equal 50, hash.buckets
+    1.upto(200){|i| assert_equal "value#{i}", hash["key#{i}"] }
+    1.upto(150){|i| hash.delete("key#{i}") }
+    assert_equal (151..200).map{|i| "key#{i}" }.sort, hash.keys.sort
+  ensure
+    hash.close
+  end
+end
@@ -20,4 +20,25 @@ class TestJio < JioTestCase
     trans.release
     assert file.close
   end
+
+  def test_crc32c
+    assert_equal 0xE3069283, JIO.crc32c("123456789")
+    assert_equal JIO.crc32c("123456789"), JIO.crc32c("6789", JIO.crc32c("12345"))
+  end
+
+  if JIO.respond_to?(:fail_at)
+    def test_fail_at
+      path = File.join(SANDBOX, 'fiu.jio')
+      pid = fork do
+        file = JIO.open(path, JIO::RDWR | JIO::CREAT | JIO::TRUNC, 0644, 0)
+        JIO.fail_at('jio/commit/tf_sync')
+        file.transaction(0){|t| t.write('CRASH', 0) }
+        exit!(0)
+      end
+      Process.wait(pid)
+      assert_equal 1, $?.exitstatus
+      assert_equal 1, JIO.check(path, 0)[:reapplied]
+      assert_equal 'CRASH', File.read(path)
+    end
+  end
 end
\ No newline at end of file
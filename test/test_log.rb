@@ -0,0 +1,98 @@
+# encoding: utf-8
+
+require File.join(File.dirname(__FILE__), 'helper')
+
+class TestLog < JioTestCase
+  LOG = File.join(SANDBOX, 'log')
+
+  def setup
+    super
+    FileUtils.rm_rf LOG
+  end
+
+  def test_append_each_from
+    log = JIO::Log.new(LOG)
+    assert_equal 0, log.last_seq
+    assert_equal 3, log.append(%w(a bb ccc))
+    assert_equal 4, log.append('dddd')
+    assert_equal [[1, 'a'], [2, 'bb'], [3, 'ccc'], [4, 'dddd']], log.each_from(1).to_a
+    assert_equal [[3, 'ccc'], [4, 'dddd']], log.each_from(3).to_a
+    assert_equal [], log.each_from(5).to_a
+  ensure
+    log.close
+  end
+
+  def test_segments
+    log = JIO::Log.new(LOG, :segment_size => 64)
+    records = (1..20).map{|i| "record #{i}" }
+    assert_equal 20, log.append(records)
+    assert log.segments.size > 1
+    assert_equal File.join(LOG, '00000000000000000001.log'), log.segments.first
+    assert_equal records, log.each_from(1).map{|seq, record| record }
+    assert_equal records[15..-1], log.each_from(16).map{|seq, record| record }
+  ensure
+    log.close
+  end
+
+  def test_recover_tail
+    log = JIO::Log.new(LOG)
+    log.append(%w(a b c))
+    log.close
+    File.open(File.join(LOG, '00000000000000000001.log'), 'ab'){|f| f << "\x00\x00\x00\x09torn" }
+    log = JIO::Log.new(LOG)
+    assert_equal 3, log.last_seq
+    assert_equal 4, log.append('d')
+    assert_equal %w(a b c d), log.each_from(1).map{|seq, record| record }
+    log.close
+    log = JIO::Log.new(LOG)
+    assert_equal 4, log.last_seq
+  ensure
+    log.close
+  end
+
+  def test_corrupt_record
+    log = JIO::Log.new(LOG)
+    log.append(%w(a b c))
+    log.close
+    File.open(File.join(LOG, '00000000000000000001.log'), 'r+b'){|f| f.seek(2 * JIO::Log::HEADER_SIZE + 1); f << 'X' }
+    log = JIO::Log.new(LOG)
+    assert_equal 1, log.last_seq
+  ensure
+    log.close
+  end
+
+  def test_index
+    log = JIO::Log.new(LOG, :index_interval => 4)
+    log.append((1..10).map{|i| "record #{i}" })
+    index = JIO::Index.new(JIO.open(File.join(LOG, '00000000000000000001.idx'), JIO::RDONLY, 0, 0))
+    assert_equal 3, index.size
+    assert_equal [1, 0], index[0]
+    assert_equal 9, index[-1][0]
+    assert_equal [5, index[1][1]], index.lookup(7)
+    assert_nil index[3]
+    path, offset = log.seek_to_seq(7)
+    assert_equal log.segments.first, path
+    assert_equal 6 * (JIO::Log::HEADER_SIZE + 8), offset
+    assert_nil log.seek_to_seq(11)
+    assert_equal ['record 7', 'record 8'], log.each_from(7).first(2).map{|seq, record| record }
+  ensure
+    index.file.close
+    log.close
+  end
+
+  def test_index_rebuild
+    log = JIO::Log.new(LOG, :index_interval => 4)
+    log.append((1..10).map{|i| "record #{i}" })
+    log.close
+    File.unlink(File.join(LOG, '00000000000000000001.idx'))
+    log = JIO::Log.new(LOG, :index_interval => 4)
+    assert_equal 10, log.last_seq
+    assert_equal ['record 9', 'record 10'], log.each_from(9).map{|seq, record| record }
+    log.append('record 11', 'record 12', 'record 13')
+    index = JIO::Index.new(JIO.open(File.join(LOG, '00000000000000000001.idx'), JIO::RDONLY, 0, 0))
+    assert_equal [1, 5, 9, 13], (0...index.size).map{|i| index[i][0] }
+  ensure
+    index.file.close
+    log.close
+  end
+end
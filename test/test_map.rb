@@ -0,0 +1,113 @@
+# encoding: utf-8
+
+require File.join(File.dirname(__FILE__), 'helper')
+
+class TestMap < JioTestCase
+  def test_map
+    file = JIO.open(*OPEN_ARGS)
+    file.pwrite('x' * 5000 + 'key=value', 0)
+    map = file.map(4990, 19)
+    assert_instance_of JIO::Map, map
+    assert_equal 19, map.size
+    assert_equal 4990, map.offset
+    assert_equal 'xxxxxxxxxxkey=value', map.to_s
+    assert_equal 'key', map[10, 3]
+    assert_equal 'e', map[-1]
+    assert_equal 'value', map[14, 100]
+    assert_nil map[20, 1]
+    assert_equal ?k.ord, map.getbyte(10)
+    assert_equal 14, map.index('value')
+    assert_nil map.index('key', 11)
+    file.pwrite('KEY', 5000)
+    assert_equal 'KEY', map[10, 3]
+    map.unmap
+    assert !map.mapped?
+    assert_raise(IOError){ map.to_s }
+    assert_raise(ArgumentError){ file.map(5000, 100) }
+    assert_equal 'x', file.map(0, 1){|m| m.to_s }
+  ensure
+    file.close
+  end
+
+  def test_map_locks
+    file = JIO.open(*OPEN_ARGS)
+    file.pwrite('abcdefgh', 0)
+    outer = file.map(0, 8)
+    inner = file.map(0, 2)
+    inner.unmap
+    pid = fork do
+      JIO.open(FILE, JIO::RDWR, 0, 0).pwrite('X', 0)
+      exit!(0)
+    end
+    sleep 0.3
+    assert_equal 'abcdefgh', outer.to_s
+    outer.unmap
+    Process.wait(pid)
+    assert_equal 'Xbcdefgh', file.pread(8, 0)
+  ensure
+    outer.unmap
+    file.close
+  end
+
+  def test_map_locks_past_offset_zero
+    file = JIO.open(*OPEN_ARGS)
+    file.pwrite('x' * 8192, 0)
+    map = file.map(4096, 4096)
+    # reads through the same handle must not release the map's lock
+    assert_equal 'x' * 10, file.pread(10, 5000)
+    file.read(8192)
+    pid = fork do
+      JIO.open(FILE, JIO::RDWR, 0, 0).pwrite('X', 5000)
+      exit!(0)
+    end
+    sleep 0.3
+    assert_nil Process.waitpid(pid, Process::WNOHANG)
+    assert_equal 'x', map[5000 - 4096]
+    map.unmap
+    Process.wait(pid)
+    assert_equal 'X', file.pread(1, 5000)
+  ensure
+    map.unmap if map
+    file.close
+  end
+
+  def test_map_locks_direct_reads
+    file = JIO.open(FILE, JIO::RDWR | JIO::CREAT | JIO::TRUNC | JIO::DIRECT, 0644, 0)
+    file.pwrite('x' * 8192, 0)
+    map = file.map(4096, 4096)
+    assert_equal 'xx', file.pread(2, 5000)
+    assert_equal '', file.pread(0, 5000)
+    pid = fork do
+      JIO.open(FILE, JIO::RDWR, 0, 0).pwrite('X', 5000)
+      exit!(0)
+    end
+    sleep 0.3
+    assert_nil Process.waitpid(pid, Process::WNOHANG)
+    map.unmap
+    Process.wait(pid)
+    assert_equal 'X', file.pread(1, 5000)
+  ensure
+    map.unmap
+    file.close
+  end
+
+  def test_map_lock_failure
+    file = JIO.open(*OPEN_ARGS)
+    file.pwrite('x' * 8192, 0)
+    held = file.map(4096, 100)
+    pid = fork do
+      # locks the first range, then waits on the map's
+      JIO.open(FILE, JIO::RDWR, 0, 0).transaction(0){|t| t.write('A', 0); t.write('B', 4096) }
+      exit!(0)
+    end
+    sleep 0.3
+    # waiting on the child's lock would deadlock
+    assert_raise(Errno::EDEADLK){ file.map(0, 100) }
+    held.unmap
+    Process.wait(pid)
+    assert_equal 'A', file.pread(1, 0)
+  ensure
+    held.unmap
+    file.close
+  end
+end
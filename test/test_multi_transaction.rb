@@ -0,0 +1,152 @@
+# encoding: utf-8
+
+require File.join(File.dirname(__FILE__), 'helper')
+
+class TestMultiTransaction < JioTestCase
+  INDEX = File.join(SANDBOX, 'index.jio')
+  INDEX_ARGS = [INDEX, JIO::RDWR | JIO::CREAT | JIO::TRUNC, 0644, JIO::J_LINGER]
+  JDIR = File.join(SANDBOX, '.file.jio.jio')
+
+  # CRC32c, as used by libjio for transaction checksums
+  def crc32c(str)
+    crc = 0xFFFFFFFF
+    str.each_byte do |b|
+      crc ^= b
+      8.times{ crc = (crc & 1) == 1 ? (crc >> 1) ^ 0x82F63B78 : crc >> 1 }
+    end
+    crc ^ 0xFFFFFFFF
+  end
+
+  def test_spawn_multi_transaction
+    file, index = JIO.open(*OPEN_ARGS), JIO.open(*INDEX_ARGS)
+    trans = JIO.transaction(file, index, file)
+    assert_instance_of JIO::MultiTransaction, trans
+    assert_equal [file, index], trans.files
+    assert_raise(ArgumentError){ JIO.transaction }
+  ensure
+    trans.release
+    assert file.close
+    assert index.close
+  end
+
+  def test_commit_multi_transaction
+    file, index = JIO.open(*OPEN_ARGS), JIO.open(*INDEX_ARGS)
+    trans = JIO.transaction(file, index)
+    trans.write(file, 'EVENT', 0)
+    trans.write(index, 'IDX', 0)
+    trans.write(file, 'V', 0)
+    assert !trans.committed?
+    assert trans.commit
+    assert trans.committed?
+    assert_equal 'VVENT', file.pread(5, 0)
+    assert_equal 'IDX', index.pread(3, 0)
+    assert_equal [], Dir.entries(JDIR).grep(/multi/)
+  ensure
+    trans.release
+    assert file.close
+    assert index.close
+  end
+
+  def test_multi_transaction_with_block
+    file, index = JIO.open(*OPEN_ARGS), JIO.open(*INDEX_ARGS)
+    JIO.transaction(file, index) do |trans|
+      trans.write(file, 'EVENT', 0)
+      trans.write(index, 'IDX', 0)
+    end
+    assert_equal 'EVENT', file.pread(5, 0)
+    assert_equal 'IDX', index.pread(3, 0)
+    JIO.transaction(file, index) do |trans|
+      trans.write(file, 'LOST', 0)
+      raise "abort"
+    end rescue nil
+    assert_equal 'EVENT', file.pread(5, 0)
+  ensure
+    assert file.close
+    assert index.close
+  end
+
+  def test_multi_transaction_write_from
+    source = File.join(SANDBOX, 'blob')
+    File.open(source, 'wb'){|f| f << 'EVENT' }
+    file, index = JIO.open(*OPEN_ARGS), JIO.open(*INDEX_ARGS)
+    JIO.transaction(file, index) do |trans|
+      assert trans.write_from(file, source, 0, 5)
+      trans.write(index, 'IDX', 0)
+    end
+    assert_equal 'EVENT', file.pread(5, 0)
+    assert_equal 'IDX', index.pread(3, 0)
+    trans = JIO.transaction(file)
+    trans.write_from(file, source, 0, 10)
+    assert_raise(Errno::EIO){ trans.commit }
+    assert_equal 'EVENT', file.pread(5, 0)
+  ensure
+    trans.release
+    assert file.close
+    assert index.close
+  end
+
+  def test_multi_transaction_invalid_operations
+    file, index = JIO.open(*OPEN_ARGS), JIO.open(*INDEX_ARGS)
+    trans = JIO.transaction(file)
+    assert_raise(ArgumentError){ trans.write(index, 'IDX', 0) }
+    assert_raise(ArgumentError){ trans.write(file, '', 0) }
+    assert_raise(IOError){ trans.commit }
+  ensure
+    trans.release
+    assert file.close
+    assert index.close
+  end
+
+  def test_check_replays_multi_transaction_record
+    file, index = JIO.open(*OPEN_ARGS), JIO.open(*INDEX_ARGS)
+    file.write('OLD')
+    file.sync
+    record = "JIOM" + [2].pack('N')
+    [FILE, INDEX].each{|f| record << [f.size].pack('N') << f }
+    record << [0, 0, 3, 0, 0].pack('NNNNN') << 'NEW'
+    record << [1, 0, 3, 0, 0].pack('NNNNN') << 'IDX'
+    record << [2].pack('N')
+    record << [crc32c(record)].pack('N')
+    File.open(File.join(JDIR, 'multi-crash'), 'wb'){|f| f << record }
+    File.open(File.join(JDIR, 'multi-torn'), 'wb'){|f| f << record[0..-3] }
+    res = JIO.check(FILE, 0)
+    assert_equal 1, res[:reapplied]
+    assert_equal 1, res[:corrupt]
+    assert_equal 'NEW', file.pread(3, 0)
+    assert_equal 'IDX', index.pread(3, 0)
+    assert_equal [], Dir.entries(JDIR).grep(/multi/)
+  ensure
+    assert file.close
+    assert index.close
+  end
+
+  def test_commit_with_relative_paths
+    file, index = Dir.chdir(SANDBOX){ [JIO.open('file.jio', *OPEN_ARGS[1..-1]), JIO.open('index.jio', *INDEX_ARGS[1..-1])] }
+    JIO.transaction(file, index){|trans| trans.write(file, 'REL', 0); trans.write(index, 'IDX', 0) }
+    file.transaction(0){|trans| trans.write('!', 3) }
+    assert_equal 'REL!', File.read(FILE)
+    assert_equal 'IDX', File.read(INDEX)
+  ensure
+    assert file.close
+    assert index.close
+  end
+
+  def test_check_skips_records_of_missing_files
+    file = JIO.open(*OPEN_ARGS)
+    missing = File.join(SANDBOX, 'missing.jio')
+    record = "JIOM" + [2].pack('N')
+    [FILE, missing].each{|f| record << [f.size].pack('N') << f }
+    record << [0, 0, 3, 0, 0].pack('NNNNN') << 'NEW'
+    record << [1, 0, 3, 0, 0].pack('NNNNN') << 'IDX'
+    record << [2].pack('N')
+    record << [crc32c(record)].pack('N')
+    File.open(File.join(JDIR, 'multi-missing'), 'wb'){|f| f << record }
+    res = JIO.check(FILE, 0)
+    assert_equal 1, res[:broken]
+    assert_equal 0, res[:reapplied]
+    assert_equal 0, File.size(FILE)
+    assert_equal [], Dir.entries(JDIR).grep(/multi/)
+  ensure
+    assert file.close
+  end
+end
@@ -0,0 +1,79 @@
+# encoding: utf-8
+
+require File.join(File.dirname(__FILE__), 'helper')
+
+class TestPageFile < JioTestCase
+  PAGES = File.join(SANDBOX, 'pages.jio')
+
+  def setup
+    super
+    File.unlink(PAGES) if File.exist?(PAGES)
+  end
+
+  def test_allocate_write_commit
+    pages = JIO::PageFile.new(PAGES, :page_size => 64)
+    assert_equal 1, pages.page_count
+    a, b, c = pages.allocate, pages.allocate, pages.allocate
+    assert_equal [1, 2, 3], [a, b, c]
+    pages.write(a, 'first')
+    pages.write(c, 'third', 10)
+    assert_equal [0, 1, 2, 3], pages.dirty_pages
+    assert_equal 4, pages.commit
+    assert_equal [], pages.dirty_pages
+    assert_equal 64 * 4, File.size(PAGES)
+    assert_equal 'first', pages.read(a, 0, 5)
+    pages.close
+    pages = JIO::PageFile.new(PAGES, :page_size => 64)
+    assert_equal 4, pages.page_count
+    assert_equal 'third', pages.read(c, 10, 5)
+    assert_raise(IndexError){ pages.read(4) }
+    assert_raise(ArgumentError){ pages.write(a, 'x' * 65) }
+  ensure
+    pages.close
+  end
+
+  def test_free_list
+    pages = JIO::PageFile.new(PAGES, :page_size => 64)
+    a, b = pages.allocate, pages.allocate
+    pages.write(b, 'data')
+    pages.free(a)
+    pages.free(b)
+    pages.commit
+    pages.close
+    pages = JIO::PageFile.new(PAGES, :page_size => 64)
+    assert_equal b, pages.allocate
+    assert_equal "\0" * 4, pages.read(b, 0, 4)
+    assert_equal a, pages.allocate
+    assert_equal 3, pages.allocate
+  ensure
+    pages.close
+  end
+
+  def test_cache_pin_rollback
+    pages = JIO::PageFile.new(PAGES, :page_size => 64, :cache_pages => 2, :shards => 1)
+    all = (1..5).map{ pages.allocate }
+    pages.commit
+    pages.pin(all[0])
+    assert pages.pinned?(all[0])
+    all.each{|page| pages.read(page) }
+    pages.unpin(all[0])
+    assert !pages.pinned?(all[0])
+    assert_raise(ArgumentError){ pages.unpin(all[0]) }
+    pages.write(all[1], 'gone')
+    pages.pin(all[2])
+    pages.pin(all[2])
+    pages.write(all[2], 'kept')
+    pages.allocate
+    pages.rollback
+    assert_equal 6, pages.page_count
+    assert_equal "\0" * 4, pages.read(all[1], 0, 4)
+    assert_equal [], pages.dirty_pages
+    assert pages.pinned?(all[2])
+    assert_equal "\0" * 4, pages.read(all[2], 0, 4)
+    pages.unpin(all[2])
+    pages.unpin(all[2])
+    assert !pages.pinned?(all[2])
+  ensure
+    pages.close
+  end
+end
@@ -0,0 +1,84 @@
+# encoding: utf-8
+
+require File.join(File.dirname(__FILE__), 'helper')
+
+class TestReader < JioTestCase
+  def test_gets_each_line
+    file = JIO.open(*OPEN_ARGS)
+    lines = (1..100).map{|i| "line #{i}\n" }
+    file.pwrite(lines.join + 'tail', 0)
+    reader = JIO::Reader.new(file, 16)
+    assert_equal "line 1\n", reader.gets
+    assert_equal 7, reader.pos
+    assert_equal lines[1..-1] + ['tail'], reader.each_line.to_a
+    assert_nil reader.gets
+    assert reader.eof?
+    reader.seek(0)
+    assert_equal lines.join + 'tail', reader.gets(nil)
+    reader.seek(0)
+    assert_equal "line 1\nl", reader.gets("\nl")
+    assert_equal "ine 2\nl", reader.gets("\nl")
+  ensure
+    file.close
+  end
+
+  def test_readpartial_getbyte
+    file = JIO.open(*OPEN_ARGS)
+    file.pwrite('ABCDEFGH', 0)
+    reader = JIO::Reader.new(file, 4)
+    assert_equal ?A.ord, reader.getbyte
+    assert_equal 'BCD', reader.readpartial(10)
+    assert_equal 'EF', reader.read_nonblock(2)
+    assert_equal 'GH', reader.readpartial(10)
+    assert_nil reader.getbyte
+    assert_raise(EOFError){ reader.readpartial(1) }
+  ensure
+    file.close
+  end
+
+  def test_separator_longer_than_buffer
+    file = JIO.open(*OPEN_ARGS)
+    file.pwrite("abc--def", 0)
+    reader = JIO::Reader.new(file, 2)
+    assert_equal 'abc--', reader.gets('--')
+    assert_raise(ArgumentError){ reader.gets('---') }
+    assert_equal 'def', reader.gets('--')
+  ensure
+    file.close
+  end
+
+  def test_invalidated_by_concurrent_commits
+    file = JIO.open(FILE, JIO::RDWR | JIO::CREAT | JIO::TRUNC, 0644, 0)
+    file.pwrite('-' * 16, 0)
+    reader = JIO::Reader.new(file, 16)
+    journal = File.join(SANDBOX, '.file.jio.jio')
+    %w(a b c d e).each do |letter|
+      committer = Thread.new do
+        file.transaction(0){|trans| trans.write(letter * 16, 0); trans.write(letter * (4 * 1024 * 1024), 4096) }
+      end
+      # refill once while the transaction is being journaled, before it's applied
+      Thread.pass while committer.alive? && (Dir.entries(journal) - %w(. .. lock)).empty?
+      reader.seek(1024)
+      reader.seek(0)
+      reader.getbyte
+      committer.join
+      reader.seek(0)
+      assert_equal letter, reader.getbyte.chr
+    end
+  ensure
+    file.close
+  end
+
+  def test_invalidated_by_writes
+    file = JIO.open(*OPEN_ARGS)
+    file.pwrite("abc\ndef\n", 0)
+    reader = JIO::Reader.new(file)
+    assert_equal "abc\n", reader.gets
+    file.pwrite('XYZ', 4)
+    assert_equal "XYZ\n", reader.gets
+    file.transaction(0){|trans| trans.write("ghi\n", 8) }
+    assert_equal "ghi\n", reader.gets
+  ensure
+    file.close
+  end
+end
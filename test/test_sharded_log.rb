@@ -0,0 +1,65 @@
+# encoding: utf-8
+
+require File.join(File.dirname(__FILE__), 'helper')
+
+class TestShardedLog < JioTestCase
+  LOG = File.join(SANDBOX, 'sharded')
+  JOURNALS = File.join(SANDBOX, 'journals')
+
+  def setup
+    super
+    FileUtils.rm_rf LOG
+    FileUtils.rm_rf JOURNALS
+  end
+
+  def test_routing_and_merge
+    log = JIO::ShardedLog.new(LOG, :shards => 3)
+    assert_equal 3, log.shards.size
+    shard = log.shard_for('order-1')
+    assert_equal [shard, 1], log.append('created', 'order-1')
+    assert_equal [shard, 2], log.append('paid', 'order-1')
+    records = (1..9).map{|i| "event #{i}" }
+    records.each{|record| log.append(record) }
+    assert_equal [3, 3, 3], log.last_seqs.each_with_index.map{|seq, i| i == shard ? seq - 2 : seq }
+    merged = log.each.map{|s, seq, record| record }
+    assert_equal %w(created paid) + records, merged
+    assert_equal ['created', 'paid'], log.each_in(shard).first(2).map{|seq, record| record }
+    log.close
+    log = JIO::ShardedLog.new(LOG, :shards => 5)
+    assert_equal 3, log.shards.size
+    log.append('later')
+    assert_equal 'later', log.each.to_a.last[2]
+    assert_equal %w(paid) + records + %w(later), log.each(shard => 2).map{|s, seq, record| record }.reject{|r| r == 'created' }
+  ensure
+    log.close
+  end
+
+  def test_concurrent_appends
+    log = JIO::ShardedLog.new(LOG, :shards => 4)
+    keys = (0...4).map{|shard| (0..1000).map{|i| "k#{i}" }.detect{|key| log.shard_for(key) == shard } }
+    threads = keys.map do |key|
+      Thread.new{ (1..20).map{|i| log.append("#{key}-#{i}", key) } }
+    end
+    results = threads.map{|thread| thread.value }
+    assert_equal [0, 1, 2, 3], results.map{|appends| appends.map{|shard, seq| shard }.uniq }.flatten
+    assert_equal [20, 20, 20, 20], log.last_seqs
+    keys.each_with_index do |key, shard|
+      assert_equal (1..20).map{|i| "#{key}-#{i}" }, log.each_in(shard).map{|seq, record| record }
+    end
+    assert_equal 80, log.each.count
+  ensure
+    log.close
+  end
+
+  def test_journal_dirs
+    log = JIO::ShardedLog.new(LOG, :shards => 2, :journal_dirs => [JOURNALS])
+    log.append('a', 'x')
+    assert File.directory?(File.join(JOURNALS, 'shard-000'))
+    assert File.directory?(File.join(JOURNALS, 'shard-001'))
+    log.close
+    log = JIO::ShardedLog.new(LOG, :journal_dirs => [JOURNALS])
+    assert_equal ['a'], log.each.map{|s, seq, record| record }
+  ensure
+    log.close
+  end
+end
@@ -0,0 +1,107 @@
+# encoding: utf-8
+
+require File.join(File.dirname(__FILE__), 'helper')
+
+class TestSnapshot < JioTestCase
+  TRACKED_ARGS = [FILE, JIO::RDWR | JIO::CREAT | JIO::TRUNC, 0644, JIO::J_LINGER | JIO::J_TRACK]
+  BACKUP = File.join(SANDBOX, 'backup.jio')
+  DIRTY = File.join(SANDBOX, '.file.jio.dirty')
+
+  def setup
+    super
+    [BACKUP, DIRTY].each{|f| File.unlink(f) if File.exist?(f) }
+  end
+
+  def teardown
+    File.unlink(DIRTY) if File.exist?(DIRTY)
+  end
+
+  def test_snapshot_to
+    file = JIO.open(*OPEN_ARGS)
+    file.pwrite('snapshot' * 1000, 0)
+    assert_raise(IOError){ file.snapshot_to(BACKUP) }
+    assert_raise(IOError){ file.export_since(0){} }
+    assert !File.exist?(DIRTY)
+    file.close
+    file = JIO.open(*TRACKED_ARGS)
+    assert File.exist?(DIRTY)
+    file.pwrite('snapshot' * 1000, 0)
+    marker = file.snapshot_to(BACKUP)
+    assert_equal File.size(DIRTY), marker
+    assert_equal 'snapshot' * 1000, File.read(BACKUP)
+  ensure
+    file.close
+  end
+
+  def test_export_since
+    file = JIO.open(*TRACKED_ARGS)
+    file.pwrite('a' * 10000, 0)
+    marker = file.snapshot_to(BACKUP)
+    file.pwrite('BB', 100)
+    file.pwrite('CC', 101)
+    file.transaction(JIO::J_LINGER){|t| t.write('DD', 5000); t.write('EE', 10000) }
+    JIO.transaction(file){|t| t.write(file, 'FF', 7000) }
+    other = JIO.open(FILE, JIO::RDWR, 0, 0)
+    other.pwrite('GG', 9000)
+    other.close
+    chunks = []
+    marker = file.export_since(marker){|offset, data| chunks << [offset, data] }
+    assert_equal [[100, 'BCC'], [5000, 'DD'], [7000, 'FF'], [9000, 'GG'], [10000, 'EE']], chunks
+    assert_equal File.size(DIRTY), marker
+    apply(chunks)
+    assert_equal file.pread(10002, 0), File.read(BACKUP)
+    assert_equal marker, file.export_since(marker){|offset, data| flunk }
+  ensure
+    file.close
+  end
+
+  def test_writers_opened_after_tracking_starts
+    untracked = JIO.open(*OPEN_ARGS)
+    file = JIO.open(FILE, JIO::RDWR, 0, JIO::J_TRACK)
+    writer = JIO.open(FILE, JIO::RDWR, 0, 0)
+    file.pwrite('a' * 100, 0)
+    marker = file.snapshot_to(BACKUP)
+    writer.pwrite('long lived', 10)
+    untracked.pwrite('lost', 50)
+    assert_equal [[10, 'long lived']], file.export_since(marker).to_a
+  ensure
+    writer.close
+    file.close
+    untracked.close
+  end
+
+  def test_export_since_truncate
+    file = JIO.open(*TRACKED_ARGS)
+    file.pwrite('a' * 100, 0)
+    marker = file.snapshot_to(BACKUP)
+    file.truncate(10)
+    file.pwrite('b', 50)
+    chunks = file.export_since(marker).to_a
+    assert_equal [[10, "\0" * 40 + 'b'], [51, nil]], chunks
+    apply(chunks)
+    assert_equal file.pread(51, 0), File.read(BACKUP)
+  ensure
+    file.close
+  end
+
+  def test_export_since_invalid_marker
+    file = JIO.open(*TRACKED_ARGS)
+    marker = file.snapshot_to(BACKUP)
+    file.pwrite('a', 0)
+    assert_raise(ArgumentError){ file.export_since(marker + 1){} }
+    assert_raise(ArgumentError){ file.export_since(File.size(DIRTY) + 16){} }
+  ensure
+    file.close
+  end
+
+  private
+  def apply(chunks)
+    File.open(BACKUP, 'r+') do |f|
+      chunks.each do |offset, data|
+        next f.truncate(offset) unless data
+        f.seek(offset)
+        f.write(data)
+      end
+    end
+  end
+end
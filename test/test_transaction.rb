@@ -108,4 +108,64 @@ class TestTransaction < JioTestCase
     trans.release
     assert file.close
   end
+
+  def test_write_from
+    source = File.join(SANDBOX, 'blob')
+    File.open(source, 'wb'){|f| f << 'B' * (3 * 1024 * 1024 + 5) }
+    file = JIO.open(*OPEN_ARGS)
+    trans = file.transaction(JIO::J_LINGER)
+    trans.write('HEAD', 0)
+    assert trans.write_from(source, 2, 3 * 1024 * 1024 + 5)
+    trans.write('TAIL', 4)
+    trans.read(3, 0)
+    assert trans.commit
+    assert trans.committed?
+    assert_equal %w(HEB), trans.views
+    assert_equal 'HEBBTAILBB', file.pread(10, 0)
+    assert_equal 3 * 1024 * 1024 + 7, File.size(FILE)
+  ensure
+    trans.release
+    assert file.close
+  end
+
+  def test_write_from_io
+    source = File.join(SANDBOX, 'blob')
+    File.open(source, 'wb'){|f| f << 'SKIPCOMMIT' }
+    file = JIO.open(*OPEN_ARGS)
+    io = File.open(source, 'rb')
+    io.read(4)
+    file.transaction(JIO::J_LINGER) do |trans|
+      trans.write_from(io, 0, 6)
+    end
+    assert_equal 4, io.pos
+    assert_equal 'COMMIT', file.pread(6, 0)
+    trans = file.transaction(JIO::J_LINGER)
+    assert_raise(Errno::ENOENT){ trans.write_from('/non/existent', 0, 1) }
+  ensure
+    trans.release
+    io.close
+    assert file.close
+  end
+
+  def test_write_from_ordering_and_rollback
+    source = File.join(SANDBOX, 'blob')
+    File.open(source, 'wb'){|f| f << 'NEW' }
+    file = JIO.open(*OPEN_ARGS)
+    file.pwrite('OLD', 0)
+    trans = file.transaction(JIO::J_LINGER)
+    trans.read(3, 0)
+    assert_raise(IOError){ trans.write_from(source, 0, 3) }
+    trans.release
+    trans = file.transaction(JIO::J_LINGER)
+    trans.write_from(source, 0, 3)
+    trans.read(3, 0)
+    assert_raise(IOError){ trans.write('X', 3) }
+    assert_raise(IOError){ trans.rollback }
+    assert trans.commit
+    assert_equal %w(NEW), trans.views
+    assert_raise(IOError){ trans.rollback }
+  ensure
+    trans.release
+    assert file.close
+  end
 end
\ No newline at end of file